@@ -0,0 +1,8 @@
+int main() {
+    int h = 7;
+    int i;
+    for (i = 0; i < 40; i = i + 1) {
+        h = h * 31 + i * 5 - (h - i) * 3;
+    }
+    return h;
+}
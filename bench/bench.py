@@ -0,0 +1,118 @@
+import os
+import re
+import subprocess
+import sys
+
+# Generated-code quality benchmark (make bench)
+#
+# Every bench/*.c program is compiled with each configuration, run to halt
+# on mincsim, and measured:
+#   words   ROM words of the program
+#   cycles  clocks until halt
+#   stack   peak stack depth in bytes (mincsim -s)
+#   frame   frame slots of all functions (mincc --stats, from generate_prologue)
+# The numbers are compared with bench/baseline.txt. A larger number is a
+# regression, a different result is an error; both make the run fail.
+# "python3 bench/bench.py --update" rewrites the baseline.
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+BASELINE = os.path.join(BENCH_DIR, "baseline.txt")
+CONFIGS = {
+    "O1": "-O1",
+    "O2": "-O2",
+    "O2-nomul": "-O2 -mno-mul",
+}
+METRICS = ("words", "cycles", "stack", "frame")
+
+def run(command:list, input_text:str=None) -> subprocess.CompletedProcess:
+    result = subprocess.run(command, input=input_text, capture_output=True, text=True)
+    if result.returncode != 0:
+        raise Exception(f"""{" ".join(command)} failed with return code {result.returncode}:\n{result.stderr.strip()}""")
+    return result
+
+def measure(path:str, flags:str) -> dict:
+    compiled = run(["./target/mincc", "--emit=hex", "--stats", *flags.split(), path])
+    frame = sum(int(m.group(1)) for m in re.finditer(r"^\[Stats\]: \S+: frame (\d+)", compiled.stderr, re.M))
+    sim = run(["./target/mincsim", "-s", *(["-mno-mul"] if "-mno-mul" in flags.split() else [])], compiled.stdout).stdout
+    return {
+        "result": int(re.search(r"TOP: (\w+)", sim).group(1), 16),
+        "words": len(compiled.stdout.split()),
+        "cycles": int(re.search(r"^Cycles: (\d+)", sim, re.M).group(1)),
+        "stack": int(re.search(r"^Peak stack: (\d+)", sim, re.M).group(1)),
+        "frame": frame,
+    }
+
+def load_baseline() -> dict:
+    # "<program> <config> <result> <words> <cycles> <stack> <frame>" per line
+    baseline = {}
+    if not os.path.exists(BASELINE):
+        return baseline
+    with open(BASELINE) as f:
+        for line in f:
+            fields = line.split()
+            if not fields or fields[0].startswith("#"):
+                continue
+            values = [int(v) for v in fields[2:]]
+            baseline[(fields[0], fields[1])] = dict(zip(("result",) + METRICS, values))
+    return baseline
+
+def save_baseline(results:dict):
+    with open(BASELINE, "w") as f:
+        f.write(f"""# {"program":<12} {"config":<9} {"result":>6} {" ".join(f"{m:>6}" for m in METRICS)}\n""")
+        for (program, config), r in results.items():
+            f.write(f"""  {program:<12} {config:<9} {r["result"]:>6} {" ".join(f"{r[m]:>6}" for m in METRICS)}\n""")
+
+def main(argv:list) -> int:
+    update = "--update" in argv
+    programs = sorted(name for name in os.listdir(BENCH_DIR) if name.endswith(".c"))
+    baseline = load_baseline()
+    results = {}
+    regressions = 0
+    errors = 0
+
+    print(f"""{"program":<12} {"config":<9} {" ".join(f"{m:>13}" for m in METRICS)}""")
+    for program in programs:
+        for config, flags in CONFIGS.items():
+            key = (program, config)
+            try:
+                r = measure(os.path.join(BENCH_DIR, program), flags)
+            except Exception as e:
+                print(f"{program:<12} {config:<9} [ERROR] {e}")
+                errors += 1
+                continue
+            results[key] = r
+            base = baseline.get(key)
+            cells = []
+            notes = []
+            for m in METRICS:
+                if base is None:
+                    cells.append(f"{r[m]:>13}")
+                    continue
+                diff = r[m] - base[m]
+                cells.append(f"{r[m]:>6} ({diff:+5})" if diff else f"{r[m]:>13}")
+                if diff > 0:
+                    notes.append(f"{m} +{diff}")
+            line = f"""{program:<12} {config:<9} {" ".join(cells)}"""
+            if base is None:
+                line += "  [NEW]"
+            elif r["result"] != base["result"]:
+                line += f"""  [ERROR] result {r["result"]}, expected {base["result"]}"""
+                errors += 1
+            elif notes:
+                line += f"""  [REGRESSION] {", ".join(notes)}"""
+                regressions += 1
+            print(line)
+
+    print()
+    if update:
+        if errors:
+            print("Baseline not updated: some programs failed")
+            return 1
+        save_baseline(results)
+        print(f"Baseline updated: {BASELINE}")
+        return 0
+    print(f"{len(results)} measurements, {regressions} regressions, {errors} errors")
+    return 1 if regressions or errors else 0
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,25 @@
+int fib(int n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int gcd(int a, int b) {
+    while (a != b) {
+        if (a > b) a = a - b;
+        else b = b - a;
+    }
+    return a;
+}
+
+int pow(int x, int n) {
+    int r = 1;
+    while (n > 0) {
+        r = r * x;
+        n = n - 1;
+    }
+    return r;
+}
+
+int main() {
+    return fib(10) + gcd(84, 60) + pow(3, 4);
+}
@@ -0,0 +1,19 @@
+int main() {
+    int x = 13;
+    int lo = 255;
+    int hi = 0;
+    int mid = 0;
+    int i = 0;
+    while (i < 50) {
+        x = x * 5 + 17;
+        if (x < lo) lo = x;
+        if (x > hi) hi = x;
+        if (x >= 64) {
+            if (x <= 192) mid = mid + 1;
+        }
+        if (x == 100) mid = mid + 10;
+        if (x != 3) mid = mid + 0;
+        i = i + 1;
+    }
+    return lo + hi + mid;
+}
@@ -0,0 +1,11 @@
+int main() {
+    int a = 1; int b = 2; int c = 3; int d = 4;
+    int e = 5; int f = 6; int g = 7; int h = 8;
+    int i = 9; int j = 10;
+    int t;
+    for (t = 0; t < 8; t = t + 1) {
+        a = a + j; b = b + a; c = c + b; d = d + c; e = e + d;
+        f = f + e; g = g + f; h = h + g; i = i + h; j = j + i;
+    }
+    return a + b * 2 + c * 3 + d + e + f + g + h + i + j;
+}
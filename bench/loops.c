@@ -0,0 +1,11 @@
+int main() {
+    int s = 0;
+    int i;
+    int j;
+    for (i = 1; i <= 12; i = i + 1) {
+        for (j = 1; j <= i; j = j + 1) {
+            s = s + i * j;
+        }
+    }
+    return s;
+}
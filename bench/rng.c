@@ -0,0 +1,23 @@
+int step(int s) {
+    return s * 13 + 7;
+}
+
+int bucket(int x) {
+    if (x < 85) return 0;
+    if (x < 170) return 1;
+    return 2;
+}
+
+int main() {
+    int s = 1;
+    int c0 = 0; int c1 = 0; int c2 = 0;
+    int i;
+    for (i = 0; i < 100; i = i + 1) {
+        s = step(s);
+        int b = bucket(s);
+        if (b == 0) c0 = c0 + 1;
+        else if (b == 1) c1 = c1 + 1;
+        else c2 = c2 + 1;
+    }
+    return c0 + c1 * 3 + c2 * 5;
+}
@@ -0,0 +1,173 @@
+import math
+import os
+import random
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+# Toolchain throughput and scaling benchmark (make bench-scale)
+#
+# Generates MinC programs and assembly files of growing size, runs mincc
+# and mincasm on them with --stats, and prints the CPU time of every phase,
+# the wall time and the peak RSS at each size. The last column is the
+# growth exponent between the two largest sizes: 1 means the phase scales
+# linearly, 2 quadratically.
+#
+#   python3 bench/scale.py [--sizes 100,1000,10000,100000] [--flags=-O2] [--keep DIR]
+#
+# At size n the MinC program has n statements, n/10 variables and n/100
+# functions; the assembly file has n instructions, n/10 labels and n/2
+# fixups. The variables and statements are spread over the functions,
+# with more functions if needed, so that no frame holds more than
+# MAX_FRAME_LOCALS locals and every frame fits in the 256-byte RAM
+# (mincc rejects larger ones). Generated programs are only compiled,
+# never run: mincc emits assembly text, and mincasm gets its own input
+# whose labels are spread over the whole file, so most of its branches
+# need the far form. The
+# assembly is capped at ASM_MAX_INSTRUCTIONS so that it still fits the
+# 64K-word address space once the page prefixes are added; mincc has no
+# such limit because its output is never assembled here.
+
+SIZES = [100, 1000, 10000, 100000]
+MAX_FRAME_LOCALS = 200
+ASM_MAX_INSTRUCTIONS = 40000
+
+def gen_minc(statements:int, variables:int, functions:int, seed:int=1) -> str:
+    # Variables and statements are spread evenly over the functions, main
+    # last; each function calls only the ones before it
+    rnd = random.Random(seed)
+    functions = max(functions, -(-variables // MAX_FRAME_LOCALS))
+    lines = []
+    for k in range(functions):
+        count = variables * (k + 1) // functions - variables * k // functions
+        body = statements * (k + 1) // functions - statements * k // functions
+        names = [f"v{variables * k // functions + i}" for i in range(max(count, 1))]
+        is_main = k == functions - 1
+        lines.append("int main() {" if is_main else f"int f{k}(int a, int b) {{")
+        for i, name in enumerate(names):
+            lines.append(f"    int {name} = {i % 256};" if is_main else f"    int {name} = a + {i % 256};")
+        var = lambda: rnd.choice(names)
+        for i in range(body):
+            form = i % 5
+            if form == 0:
+                lines.append(f"    {var()} = {var()} + {var()} * {rnd.randrange(1, 16)};")
+            elif form == 1:
+                lines.append(f"    if ({var()} < {var()}) {var()} = {var()} - 1; else {var()} = {var()} + {var()};")
+            elif form == 2:
+                lines.append(f"    while ({var()} != 0) {{ {var()} = {var()} - {rnd.randrange(1, 4)}; }}")
+            elif form == 3 and k > 0:
+                lines.append(f"    {var()} = f{rnd.randrange(k)}({var()}, {var()});")
+            else:
+                lines.append(f"    {var()} = {var()} - {var()} + {rnd.randrange(256)};")
+        lines.append(f"    return {var()};")
+        lines.append("}")
+    return "\n".join(lines) + "\n"
+
+def gen_asm(instructions:int, labels:int, fixups:int, seed:int=1) -> str:
+    # Labels and fixups are spread over the whole file; fixups name
+    # random labels
+    rnd = random.Random(seed)
+    slots = instructions
+    lines = []
+    next_label = 0
+    for i in range(instructions):
+        while next_label < labels and next_label * slots // labels == i:
+            lines.append(f"L{next_label}:")
+            next_label += 1
+        if i * fixups // instructions != (i + 1) * fixups // instructions:
+            kind = rnd.randrange(3)
+            label = f"L{rnd.randrange(labels)}"
+            lines.append(f"jz {label},r{rnd.randrange(16)}" if kind == 0 else f"jnz {label},r{rnd.randrange(16)}" if kind == 1 else f"call {label}")
+        else:
+            kind = rnd.randrange(4)
+            rd, rs = rnd.randrange(16), rnd.randrange(16)
+            lines.append(f"add r{rd},r{rs}" if kind == 0 else f"mvi r{rd},{rnd.randrange(256)}" if kind == 1 else f"push r{rs}" if kind == 2 else f"mov r{rd},r{rs}")
+    lines.append("halt")
+    return "\n".join(lines) + "\n"
+
+def run(command:list, input_path:str) -> dict:
+    # Phase times, wall time and peak RSS (KiB) of one run. The tools report
+    # their own peak RSS: a child's ru_maxrss would include the Python
+    # process it was forked from.
+    with open(input_path) as stdin:
+        start = time.perf_counter()
+        proc = subprocess.run(command, stdin=stdin, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+        wall = time.perf_counter() - start
+    if proc.returncode != 0:
+        raise Exception(f"""{" ".join(command)} failed:\n{proc.stderr.strip()}""")
+    result = {phase: float(t) for phase, t in re.findall(r"^\[Time\]: (\w+) ([\d.]+) s", proc.stderr, re.M)}
+    result["total"] = wall
+    rss = re.search(r"^\[Stats\]: peak RSS (\d+) kB", proc.stderr, re.M)
+    if rss:
+        result["rss"] = int(rss.group(1))
+    return result
+
+def growth(sizes:list, values:list) -> str:
+    if len(sizes) < 2 or values[-1] <= 0 or values[-2] <= 0:
+        return "-"
+    return f"{math.log(values[-1] / values[-2]) / math.log(sizes[-1] / sizes[-2]):.2f}"
+
+def report(title:str, sizes:list, runs:list):
+    print(title)
+    print(f"""  {"phase":<10} {"".join(f"{n:>12}" for n in sizes)}  {"growth":>6}""")
+    for phase in runs[0]:
+        values = [r.get(phase, 0.0) for r in runs]
+        if phase == "rss":
+            cells = "".join(f"{v / 1024:>9.1f} MB" for v in values)
+        else:
+            cells = "".join(f"{v * 1000:>9.2f} ms" for v in values)
+        print(f"""  {"peak RSS" if phase == "rss" else phase:<10} {cells}  {growth(sizes, values):>6}""")
+    print()
+
+def main(argv:list) -> int:
+    sizes = SIZES
+    flags = ["-O0", "-O2"]
+    keep = None
+    i = 0
+    while i < len(argv):
+        if argv[i] == "--sizes" and i + 1 < len(argv):
+            sizes = [int(n) for n in argv[i + 1].split(",")]
+            i += 1
+        elif argv[i].startswith("--flags="):
+            flags = [argv[i][len("--flags="):]]
+        elif argv[i] == "--keep" and i + 1 < len(argv):
+            keep = argv[i + 1]
+            i += 1
+        else:
+            print("Usage: scale.py [--sizes n,n,...] [--flags=FLAGS] [--keep DIR]", file=sys.stderr)
+            return 1
+        i += 1
+
+    with tempfile.TemporaryDirectory() as tmp:
+        work = keep or tmp
+        os.makedirs(work, exist_ok=True)
+        c_files, s_files = [], []
+        for n in sizes:
+            c_files.append(os.path.join(work, f"gen_{n}.c"))
+            with open(c_files[-1], "w") as f:
+                f.write(gen_minc(n, max(n // 10, 1), max(n // 100, 1)))
+        asm_sizes = []
+        for n in sizes:
+            n = min(n, ASM_MAX_INSTRUCTIONS)
+            if n in asm_sizes:
+                continue
+            asm_sizes.append(n)
+            s_files.append(os.path.join(work, f"gen_{n}.s"))
+            with open(s_files[-1], "w") as f:
+                f.write(gen_asm(n, max(n // 10, 1), n // 2))
+
+        try:
+            for flag in flags:
+                runs = [run(["./target/mincc", "--stats", *flag.split()], path) for path in c_files]
+                report(f"mincc {flag}", sizes, runs)
+            runs = [run(["./target/mincasm", "--stats"], path) for path in s_files]
+            report("mincasm", asm_sizes, runs)
+        except Exception as e:
+            print(f"[ERROR] {e}")
+            return 1
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
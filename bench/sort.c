@@ -0,0 +1,20 @@
+int min(int a, int b) {
+    if (a < b) return a;
+    return b;
+}
+
+int max(int a, int b) {
+    if (a < b) return b;
+    return a;
+}
+
+int main() {
+    int a = 91; int b = 12; int c = 200; int d = 3;
+    int t;
+    t = min(a, b); b = max(a, b); a = t;
+    t = min(c, d); d = max(c, d); c = t;
+    t = min(a, c); c = max(a, c); a = t;
+    t = min(b, d); d = max(b, d); b = t;
+    t = min(b, c); c = max(b, c); b = t;
+    return a + b * 2 + c * 3 + d * 4;
+}
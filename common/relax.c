@@ -0,0 +1,78 @@
+#include "relax.h"
+
+/***************************************************************
+Branch relaxation
+
+jz/jnz/call hold the low 8 bits of the target, and the high bits are
+those of the branch word: a near branch reaches its own 256-word page.
+A branch whose label lies in another page takes the far form, a page
+prefix (000 1101 pppp pppp) followed by the branch. Labels point at
+the prefix.
+
+Every branch starts near; a pass measures the layout of the previous
+one and turns each near branch that leaves its page into a far one.
+Branches never shrink, so this ends, usually after a pass or two.
+mincasm and mincc --emit=hex both go through here, which keeps
+--emit=hex equal to mincc | mincasm.
+****************************************************************/
+
+// Address of near-form word index once the page prefixes are in: the
+// index plus the prefixes of far branches before it (shift counts the
+// far ones in front of each branch)
+static long final_address(const Branch *br, size_t count, long index) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (br[mid].index < index) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < count) {
+        return index + br[lo].shift;
+    }
+    if (lo == 0) {
+        return index;
+    }
+    return index + br[lo - 1].shift + br[lo - 1].far;
+}
+
+long relax_branches(Branch *br, size_t count, size_t code_size) {
+    long nfar;
+    int changed;
+    do {
+        nfar = 0;
+        for (size_t i = 0; i < count; i++) {
+            br[i].shift = nfar;
+            nfar += br[i].far;
+        }
+        changed = 0;
+        for (size_t i = 0; i < count; i++) {
+            Branch *b = &br[i];
+            if (!b->far && ((b->index + b->shift) ^ final_address(br, count, b->target)) >> 8) {
+                b->far = 1;
+                changed = 1;
+            }
+        }
+    } while (changed);
+    return (long)code_size + nfar;
+}
+
+void place_branches(const uint16_t *code, size_t code_size, const Branch *br, size_t count, uint16_t *out) {
+    size_t from = 0, to = 0;
+    for (size_t i = 0; i < count; i++) {
+        long addr = final_address(br, count, br[i].target);
+        while (from < (size_t)br[i].index) {
+            out[to++] = code[from++];
+        }
+        if (br[i].far) {
+            out[to++] = (uint16_t)(PAGE_OPCODE | addr >> 8);
+        }
+        // keep the opcode and rs, set the target in bits 11:4
+        out[to++] = (uint16_t)((code[from++] & 0xF00F) | (addr & 0xFF) << 4);
+    }
+    while (from < code_size) {
+        out[to++] = code[from++];
+    }
+}
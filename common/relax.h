@@ -0,0 +1,30 @@
+#ifndef MINC_RELAX_H
+#define MINC_RELAX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Branch relaxation and placement shared by mincasm and mincc --emit=hex
+// (part of libminc, not exported)
+
+#define PAGE_OPCODE 0x0D00     // page p: high address byte of the next branch
+#define MAX_PROGRAM_WORDS 0x10000
+
+// A jz/jnz/call to a label. Indices count words of the near-form code,
+// in which every branch is one word and there are no page prefixes.
+typedef struct {
+    long index;   // the branch word
+    long target;  // the label
+    int far;      // set by relax_branches: needs a page prefix
+    long shift;   // set by relax_branches: page prefixes in front of it
+} Branch;
+
+// Decide which branches (sorted by index) need the far form and return
+// the program size in words once their page prefixes are in
+long relax_branches(Branch *br, size_t count, size_t code_size);
+
+// Copy the near-form code to out (the size relax_branches returned),
+// inserting the page prefixes and patching the 8-bit branch targets
+void place_branches(const uint16_t *code, size_t code_size, const Branch *br, size_t count, uint16_t *out);
+
+#endif
@@ -0,0 +1,164 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tool.h"
+
+// Helpers shared by the mincc and mincasm command-line front ends
+
+/***************************************************************
+Output
+
+Every format goes through one buffered Writer; words are converted
+to text by hand instead of one printf per word. mincasm offers all
+formats (-f), mincc --emit=hex/bin the first and the third.
+
+  hex     $readmemh: one 4-digit hex word per line (default)
+  memb    $readmemb: one 15-digit binary word per line
+  bin     raw 16-bit little-endian words
+  ihex    Intel HEX, 2 bytes per word, little-endian
+  packed  15-bit words packed LSB-first into a byte stream, no
+          padding between words (BRAM init bitstream)
+****************************************************************/
+
+#define WRITER_BUF_SIZE (64 * 1024)
+
+typedef struct {
+    FILE *fp;
+    size_t len;
+    int failed;
+    char buf[WRITER_BUF_SIZE];
+} Writer;
+
+static void writer_flush(Writer *w) {
+    if (w->len && fwrite(w->buf, 1, w->len, w->fp) != w->len) {
+        w->failed = 1;
+    }
+    w->len = 0;
+}
+
+static void writer_byte(Writer *w, int c) {
+    if (w->len == sizeof(w->buf)) {
+        writer_flush(w);
+    }
+    w->buf[w->len++] = (char)c;
+}
+
+// n hex digits of v, most significant first
+static void writer_hex(Writer *w, unsigned v, int n) {
+    static const char digits[] = "0123456789ABCDEF";
+    while (n--) {
+        writer_byte(w, digits[(v >> (n * 4)) & 0xF]);
+    }
+}
+
+// One Intel HEX record: :LLAAAATT<data>CC
+static void write_ihex_record(Writer *w, unsigned addr, int type, const uint8_t *data, size_t n) {
+    unsigned sum = (unsigned)n + ((addr >> 8) & 0xFF) + (addr & 0xFF) + (unsigned)type;
+    writer_byte(w, ':');
+    writer_hex(w, (unsigned)n, 2);
+    writer_hex(w, addr & 0xFFFF, 4);
+    writer_hex(w, (unsigned)type, 2);
+    for (size_t i = 0; i < n; i++) {
+        writer_hex(w, data[i], 2);
+        sum += data[i];
+    }
+    writer_hex(w, (0x100 - (sum & 0xFF)) & 0xFF, 2);
+    writer_byte(w, '\n');
+}
+
+static void write_code(Writer *w, const MincWords *code, OutputFormat format) {
+    switch (format) {
+    case OUT_HEX:
+        for (size_t i = 0; i < code->count; i++) {
+            writer_hex(w, code->data[i], 4);
+            writer_byte(w, '\n');
+        }
+        break;
+    case OUT_MEMB:
+        for (size_t i = 0; i < code->count; i++) {
+            for (int b = 14; b >= 0; b--) {
+                writer_byte(w, '0' + ((code->data[i] >> b) & 1));
+            }
+            writer_byte(w, '\n');
+        }
+        break;
+    case OUT_BIN:
+        for (size_t i = 0; i < code->count; i++) {
+            writer_byte(w, code->data[i] & 0xFF);
+            writer_byte(w, code->data[i] >> 8);
+        }
+        break;
+    case OUT_IHEX: {
+        uint8_t rec[16];
+        size_t n = 0;
+        unsigned addr = 0;
+        for (size_t i = 0; i < code->count; i++) {
+            if (n == 0 && addr && (addr & 0xFFFF) == 0) {
+                // past 64 KiB (PC_WIDTH 16): extended linear address
+                uint8_t upper[2] = {(uint8_t)(addr >> 24), (uint8_t)(addr >> 16)};
+                write_ihex_record(w, 0, 0x04, upper, 2);
+            }
+            rec[n++] = code->data[i] & 0xFF;
+            rec[n++] = code->data[i] >> 8;
+            if (n == sizeof(rec)) {
+                write_ihex_record(w, addr, 0x00, rec, n);
+                addr += (unsigned)n;
+                n = 0;
+            }
+        }
+        if (n) {
+            write_ihex_record(w, addr, 0x00, rec, n);
+        }
+        write_ihex_record(w, 0, 0x01, NULL, 0); // end of file
+        break;
+    }
+    case OUT_PACKED: {
+        uint32_t acc = 0;
+        int bits = 0;
+        for (size_t i = 0; i < code->count; i++) {
+            acc |= (uint32_t)(code->data[i] & 0x7FFF) << bits;
+            bits += 15;
+            while (bits >= 8) {
+                writer_byte(w, acc & 0xFF);
+                acc >>= 8;
+                bits -= 8;
+            }
+        }
+        if (bits) {
+            writer_byte(w, acc & 0xFF);
+        }
+        break;
+    }
+    }
+}
+
+int write_words(FILE *fp, const MincWords *code, OutputFormat format) {
+    static Writer w;
+    w.fp = fp;
+    w.len = 0;
+    w.failed = 0;
+    write_code(&w, code, format);
+    writer_flush(&w);
+    if (fflush(fp) != 0) {
+        w.failed = 1;
+    }
+    return !w.failed;
+}
+
+// Peak resident set size for --stats (Linux: VmHWM in /proc/self/status)
+void report_peak_rss(void) {
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (!fp) {
+        return;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            fprintf(stderr, "[Stats]: peak RSS %ld kB\n", strtol(line + 6, NULL, 10));
+            break;
+        }
+    }
+    fclose(fp);
+}
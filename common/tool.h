@@ -0,0 +1,18 @@
+#ifndef MINC_TOOL_H
+#define MINC_TOOL_H
+
+#include <stdio.h>
+
+#include "minc.h"
+
+// Helpers shared by the mincc and mincasm front ends (not part of libminc)
+
+typedef enum { OUT_HEX, OUT_MEMB, OUT_BIN, OUT_IHEX, OUT_PACKED } OutputFormat;
+
+// Write code to fp in format and flush it. Returns 0 on a write error.
+int write_words(FILE *fp, const MincWords *code, OutputFormat format);
+
+// Print the peak resident set size to stderr for --stats (Linux only)
+void report_peak_rss(void);
+
+#endif
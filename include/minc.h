@@ -0,0 +1,69 @@
+#ifndef MINC_H
+#define MINC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/***************************************************************
+libminc: the MinC compiler and assembler as a library
+
+Each call keeps its state in its own context, so calls can be made
+repeatedly (and from several threads) in one process. Errors are
+reported as a MincStatus and a diagnostic on opts->diag; nothing
+calls exit().
+
+    char *asm_text;
+    MincWords words;
+    if (minc_compile(src, len, &asm_text) == MINC_OK &&
+        minc_assemble(asm_text, strlen(asm_text), &words) == MINC_OK) {
+        ... words.data[0 .. words.count-1] ...
+    }
+    free(asm_text);
+    free(words.data);
+****************************************************************/
+
+typedef enum {
+    MINC_OK = 0,
+    MINC_ERR_SYNTAX,    // malformed program or assembly line
+    MINC_ERR_RANGE,     // number, register or address out of range
+    MINC_ERR_UNDEFINED, // undefined or duplicate label
+    MINC_ERR_NOMEM,     // out of memory
+    MINC_ERR_INTERNAL,  // compiler bug
+} MincStatus;
+
+typedef struct {
+    int opt_level;          // -O level, 0..2
+    int regalloc;           // register allocation (implied by opt_level >= 2)
+    int no_mul;             // target core without multiplier (HAS_MUL = 0)
+    int verbose;            // dump tokens to diag
+    int stats;              // report frame sizes and phase times to diag
+    const char *input_name; // name used in diagnostics, "<stdin>" if NULL
+    FILE *diag;             // diagnostics, or NULL to discard them
+} MincOptions;
+
+// Assembled program: one 15-bit instruction word per element
+typedef struct {
+    uint16_t *data; // malloc'd, free() when done
+    size_t count;
+} MincWords;
+
+// Compile src (len bytes) to assembly text. *asm_buf receives a
+// malloc'd, null-terminated buffer, or NULL on error.
+// minc_compile uses the defaults (-O0) and reports to stderr.
+int minc_compile(const char *src, size_t len, char **asm_buf);
+int minc_compile_opts(const char *src, size_t len, const MincOptions *opts, char **asm_buf);
+
+// Compile src straight to machine code, without the assembly text
+// round trip. Same words as minc_compile_opts + minc_assemble.
+int minc_compile_words(const char *src, size_t len, const MincOptions *opts, MincWords *words);
+
+// Assemble asm_text (len bytes). On error words is left empty.
+// minc_assemble reports to stderr.
+int minc_assemble(const char *asm_text, size_t len, MincWords *words);
+int minc_assemble_opts(const char *asm_text, size_t len, const MincOptions *opts, MincWords *words);
+
+// Short description of a status
+const char *minc_strerror(int status);
+
+#endif
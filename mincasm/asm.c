@@ -0,0 +1,561 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "minc.h"
+#include "relax.h"
+
+/***************************************************************
+Assembler core (libminc)
+
+minc_assemble_opts() assembles a buffer in one pass, backpatching
+label operands once all labels are known. All state lives in an
+Assembler; errors are printed to the diag stream and returned as a
+MincStatus.
+
+Label operands are backpatched by relax_branches / place_branches
+(common/relax.c), which add a page prefix in front of each branch
+whose label lies in another 256-word page. Numeric address operands
+are always near.
+****************************************************************/
+
+// Operand formats
+typedef enum {
+    OPR_RR,      // op rd,rs
+    OPR_RD,      // op rd   (register in bits 7:4)
+    OPR_RS,      // op rs   (register in bits 3:0)
+    OPR_RI,      // op rd,n
+    OPR_IR,      // op n,rs
+    OPR_ADDR,    // op addr
+    OPR_ADDR_RS, // op addr,rs
+    OPR_NONE,    // op
+} OperandFormat;
+
+// How a label operand is patched once its address is known
+typedef enum {
+    FIX_NONE,    // no label operand
+    FIX_ADDR8,   // low address byte in bits 11:4 (high byte: page prefix)
+} FixupKind;
+
+typedef struct {
+    const char *name;
+    int opcode;
+    OperandFormat format;
+    FixupKind fixup;
+} InstDesc;
+
+static const InstDesc inst_table[] = {
+    {"mov",  0x0000, OPR_RR,      FIX_NONE},
+    {"add",  0x0100, OPR_RR,      FIX_NONE},
+    {"sub",  0x0200, OPR_RR,      FIX_NONE},
+    {"lt",   0x0300, OPR_RR,      FIX_NONE},
+    {"mul",  0x0400, OPR_RR,      FIX_NONE},
+    {"push", 0x0800, OPR_RS,      FIX_NONE},
+    {"sts",  0x0900, OPR_RS,      FIX_NONE},
+    {"pop",  0x0A00, OPR_RD,      FIX_NONE},
+    {"lds",  0x0B00, OPR_RD,      FIX_NONE},
+    {"ret",  0x0C00, OPR_NONE,    FIX_NONE},
+    {"mvi",  0x1000, OPR_RI,      FIX_NONE},
+    {"stm",  0x2000, OPR_IR,      FIX_NONE},
+    {"ldm",  0x3000, OPR_RI,      FIX_NONE},
+    {"jz",   0x4000, OPR_ADDR_RS, FIX_ADDR8},
+    {"call", 0x5000, OPR_ADDR,    FIX_ADDR8},
+    {"jnz",  0x6000, OPR_ADDR_RS, FIX_ADDR8},
+    {"halt", 0x7FFF, OPR_NONE,    FIX_NONE},
+};
+
+#define INST_TABLE_SIZE (sizeof(inst_table) / sizeof(inst_table[0]))
+#define INST_HASH_SIZE 64 // power of two, well above INST_TABLE_SIZE
+
+// Labels are interned: one Symbol per distinct name, shared by the
+// definition and every fixup that refers to it.
+typedef struct Symbol {
+    struct Symbol *next; // hash chain
+    int address;         // instruction index, -1 until defined
+    unsigned long hash;
+    char name[];
+} Symbol;
+
+typedef struct {
+    int index;       // word to patch
+    Symbol *sym;     // label to resolve
+} Fixup;
+
+typedef struct {
+    uint16_t *data;
+    size_t size;
+    size_t cap;
+} CodeVec;
+
+typedef struct {
+    const InstDesc *inst_hash[INST_HASH_SIZE];
+    Symbol **buckets; size_t bucket_count; size_t syms_size;
+    Fixup  *fix;  size_t fix_size;  size_t fix_cap;
+    CodeVec code;
+    FILE *diag;
+    int stats;             // report phase times to diag
+    clock_t phase_start;
+    MincStatus status;
+} Assembler;
+
+// Print "Error: ..." and record status. Always returns 0.
+static int asm_error(Assembler *as, MincStatus status, const char *fmt, ...) {
+    if (as->diag) {
+        va_list ap;
+        va_start(ap, fmt);
+        fprintf(as->diag, "Error: ");
+        vfprintf(as->diag, fmt, ap);
+        fprintf(as->diag, "\n");
+        va_end(ap);
+    }
+    as->status = status;
+    return 0;
+}
+
+// FNV-1a
+static unsigned long hash_str(const char *s, size_t len) {
+    unsigned long h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Build the open-addressed mnemonic table
+static void init_inst_hash(Assembler *as) {
+    for (size_t i = 0; i < INST_TABLE_SIZE; i++) {
+        const char *name = inst_table[i].name;
+        unsigned long h = hash_str(name, strlen(name)) & (INST_HASH_SIZE - 1);
+        while (as->inst_hash[h]) {
+            h = (h + 1) & (INST_HASH_SIZE - 1);
+        }
+        as->inst_hash[h] = &inst_table[i];
+    }
+}
+
+static const InstDesc *find_inst(Assembler *as, const char *name) {
+    unsigned long h = hash_str(name, strlen(name)) & (INST_HASH_SIZE - 1);
+    while (as->inst_hash[h]) {
+        if (strcmp(as->inst_hash[h]->name, name) == 0) {
+            return as->inst_hash[h];
+        }
+        h = (h + 1) & (INST_HASH_SIZE - 1);
+    }
+    return NULL; // Not found
+}
+
+static int check_register_range(Assembler *as, int reg) {
+    if (reg < 0 || reg > 15) {
+        return asm_error(as, MINC_ERR_RANGE, "Register out of range: r%d", reg);
+    }
+    return 1; // In range
+}
+
+static int check_immediate_range(Assembler *as, int imm) {
+    if (imm < -128 || imm > 255) {
+        return asm_error(as, MINC_ERR_RANGE, "Immediate value out of range: %d", imm);
+    }
+    return 1; // In range
+}
+
+static char *find_comma(Assembler *as, char *str, char *inst) {
+    char *comma = strchr(str, ',');
+    if (comma == NULL) {
+        asm_error(as, MINC_ERR_SYNTAX, "Expected two arguments in instruction '%s'", inst);
+        return NULL;
+    }
+    return comma;
+}
+
+static int codevec_push(CodeVec *v, uint16_t word) {
+    if (v->size == v->cap) {
+        size_t ncap = v->cap ? v->cap * 2 : 64;
+        uint16_t *nd = (uint16_t *)realloc(v->data, ncap * sizeof(uint16_t));
+        if (!nd) return 0;
+        v->data = nd; v->cap = ncap;
+    }
+    v->data[v->size++] = word;
+    return 1;
+}
+
+static int grow_symbols(Assembler *as) {
+    size_t ncount = as->bucket_count ? as->bucket_count * 2 : 256;
+    Symbol **nb = (Symbol **)calloc(ncount, sizeof(Symbol *));
+    if (!nb) return 0;
+    for (size_t i = 0; i < as->bucket_count; i++) {
+        Symbol *sym = as->buckets[i];
+        while (sym) {
+            Symbol *next = sym->next;
+            size_t b = sym->hash & (ncount - 1);
+            sym->next = nb[b];
+            nb[b] = sym;
+            sym = next;
+        }
+    }
+    free(as->buckets);
+    as->buckets = nb; as->bucket_count = ncount;
+    return 1;
+}
+
+// Find the symbol for name, creating an undefined one on first sight
+static Symbol *intern_symbol(Assembler *as, const char *name) {
+    size_t len = strlen(name);
+    unsigned long h = hash_str(name, len);
+    if (as->bucket_count) {
+        for (Symbol *sym = as->buckets[h & (as->bucket_count - 1)]; sym; sym = sym->next) {
+            if (sym->hash == h && strcmp(sym->name, name) == 0) return sym;
+        }
+    }
+    if (as->syms_size >= as->bucket_count && !grow_symbols(as)) {
+        asm_error(as, MINC_ERR_NOMEM, "out of memory");
+        return NULL;
+    }
+    Symbol *sym = (Symbol *)malloc(sizeof(Symbol) + len + 1);
+    if (!sym) {
+        asm_error(as, MINC_ERR_NOMEM, "out of memory");
+        return NULL;
+    }
+    memcpy(sym->name, name, len + 1);
+    sym->address = -1;
+    sym->hash = h;
+    size_t b = h & (as->bucket_count - 1);
+    sym->next = as->buckets[b];
+    as->buckets[b] = sym;
+    as->syms_size++;
+    return sym;
+}
+
+static int add_symbol(Assembler *as, const char *name, int addr) {
+    Symbol *sym = intern_symbol(as, name);
+    if (!sym) return 0;
+    if (sym->address >= 0) {
+        return asm_error(as, MINC_ERR_UNDEFINED, "Duplicate label '%s'", name);
+    }
+    sym->address = addr;
+    return 1;
+}
+
+static int add_fixup(Assembler *as, int index, const char *name) {
+    if (as->fix_size == as->fix_cap) {
+        size_t ncap = as->fix_cap ? as->fix_cap * 2 : 64;
+        Fixup *nf = (Fixup *)realloc(as->fix, ncap * sizeof(Fixup));
+        if (!nf) return asm_error(as, MINC_ERR_NOMEM, "out of memory");
+        as->fix = nf; as->fix_cap = ncap;
+    }
+    Symbol *sym = intern_symbol(as, name);
+    if (!sym) return 0;
+    as->fix[as->fix_size].index = index;
+    as->fix[as->fix_size].sym = sym;
+    as->fix_size++;
+    return 1;
+}
+
+static void rtrim(char *s) {
+    size_t n = strlen(s);
+    while (n > 0 && (s[n-1] == ' ' || s[n-1] == '\t')) {
+        s[--n] = '\0';
+    }
+}
+
+static char *lskip(char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    return s;
+}
+
+static int is_valid_label_name(const char *s) {
+    if (!(*s == '_' || isalpha((unsigned char)*s))) return 0;
+    s++;
+    while (*s) {
+        if (!(*s == '_' || isalnum((unsigned char)*s))) return 0;
+        s++;
+    }
+    return 1;
+}
+
+// Process optional leading label: updates *pp to start of instruction part.
+// Returns 1 if the line is only a label (should skip instruction parsing),
+// 0 if instruction follows (continue parsing), and -1 on error.
+static int process_label(Assembler *as, char **pp, int instr_index) {
+    char *p = *pp;
+    char *colon = strchr(p, ':');
+    if (colon) {
+        char *ws = p;
+        while (*ws && *ws != ' ' && *ws != '\t') ws++;
+        if (colon < ws) {
+            char labbuf[128];
+            size_t len = (size_t)(colon - p);
+            if (len >= sizeof(labbuf)) {
+                asm_error(as, MINC_ERR_SYNTAX, "Label too long");
+                return -1;
+            }
+            memcpy(labbuf, p, len);
+            labbuf[len] = '\0';
+            if (!is_valid_label_name(labbuf)) {
+                asm_error(as, MINC_ERR_SYNTAX, "Invalid label name '%s'", labbuf);
+                return -1;
+            }
+            if (!add_symbol(as, labbuf, instr_index)) {
+                return -1;
+            }
+            p = lskip(colon + 1);
+            *pp = p;
+            if (*p == '\0') return 1; // label-only line
+        }
+    }
+    return 0;
+}
+
+// Copy a label operand (up to whitespace or ',') into tok and validate it.
+// Returns 0 on error.
+static int parse_label_operand(Assembler *as, const char *s, char *tok, size_t size) {
+    size_t ti = 0;
+    while (s[ti] && s[ti] != ' ' && s[ti] != '\t' && s[ti] != ',') {
+        if (ti + 1 >= size) {
+            return asm_error(as, MINC_ERR_SYNTAX, "Label too long");
+        }
+        tok[ti] = s[ti];
+        ti++;
+    }
+    tok[ti] = '\0';
+    if (!is_valid_label_name(tok)) {
+        return asm_error(as, MINC_ERR_SYNTAX, "Invalid label name '%s'", tok);
+    }
+    return 1;
+}
+
+// Patch a resolved address into the word
+static uint16_t apply_fixup(uint16_t word, FixupKind kind, int addr) {
+    switch (kind) {
+    case FIX_ADDR8:
+        // keep top nibble and low nibble, set middle 8 bits with (addr<<4)
+        return (uint16_t)((word & 0xF00F) | ((addr & 0xFF) << 4));
+    default:
+        return word;
+    }
+}
+
+// Assemble one line (without its newline). Returns 0 on error.
+static int assemble_line(Assembler *as, char *line_to_assemble, int *instr_index) {
+    // Skip leading whitespace and ignore empty/comment lines
+    char *p = lskip(line_to_assemble);
+    if (*p == '\0') return 1;
+    if (*p == ';' || *p == '#') return 1;
+
+    // handle label via helper
+    {
+        int lr = process_label(as, &p, *instr_index);
+        if (lr < 0) return 0;
+        if (lr > 0) return 1; // label-only line
+    }
+
+    // parse instruction from p
+    rtrim(p);
+    char *first_space = strchr(p, ' ');
+    char instruction[32] = {'\0'};
+    if (first_space == NULL) {
+        strncpy(instruction, p, sizeof(instruction) - 1);
+        instruction[sizeof(instruction) - 1] = '\0';
+    } else {
+        size_t n = (size_t)(first_space - p);
+        if (n >= sizeof(instruction)) n = sizeof(instruction) - 1;
+        memcpy(instruction, p, n);
+        instruction[n] = '\0';
+    }
+
+    const InstDesc *desc = find_inst(as, instruction);
+    if (desc == NULL) {
+        return asm_error(as, MINC_ERR_SYNTAX, "Unknown instruction '%s'", instruction);
+    }
+    int opcode = desc->opcode;
+    if (desc->format != OPR_NONE && first_space == NULL) {
+        return asm_error(as, MINC_ERR_SYNTAX, "Missing operand for '%s'", instruction);
+    }
+
+    const char *label = NULL; // label operand to fix up later
+    char tok[128];
+    switch (desc->format) {
+    case OPR_RR: {
+        char *comma = find_comma(as, first_space + 1, instruction);
+        if (comma == NULL) return 0;
+        char* operand1 = first_space + 1;
+        char* operand2 = comma + 1;
+        int reg1 = strtol(operand1 + 1, NULL, 10);
+        int reg2 = strtol(operand2 + 1, NULL, 10);
+        if (!check_register_range(as, reg1) || !check_register_range(as, reg2)) return 0;
+        opcode = opcode | (reg1 << 4) | reg2;
+        break;
+    }
+    case OPR_RD: {
+        char* operand = first_space + 1;
+        int reg = strtol(operand + 1, NULL, 10);
+        if (!check_register_range(as, reg)) return 0;
+        opcode = opcode | (reg << 4);
+        break;
+    }
+    case OPR_RS: {
+        char* operand = first_space + 1;
+        int reg = strtol(operand + 1, NULL, 10);
+        if (!check_register_range(as, reg)) return 0;
+        opcode = opcode | reg;
+        break;
+    }
+    case OPR_RI: {
+        char *comma = find_comma(as, first_space + 1, instruction);
+        if (comma == NULL) return 0;
+        char* operand = first_space + 1;
+        char* immediate = comma + 1;
+        int reg = strtol(operand + 1, NULL, 10);
+        int imm = strtol(immediate, NULL, 0);
+        if (!check_immediate_range(as, imm) || !check_register_range(as, reg)) return 0;
+        opcode = opcode | ((imm & 0xff) << 4) | reg;
+        break;
+    }
+    case OPR_IR: {
+        char *comma = find_comma(as, first_space + 1, instruction);
+        if (comma == NULL) return 0;
+        char* immediate = first_space + 1;
+        char* operand = comma + 1;
+        int imm = strtol(immediate, NULL, 0);
+        int reg = strtol(operand + 1, NULL, 10);
+        if (!check_immediate_range(as, imm) || !check_register_range(as, reg)) return 0;
+        opcode = opcode | ((imm & 0xff) << 4) | reg;
+        break;
+    }
+    case OPR_ADDR:
+    case OPR_ADDR_RS: {
+        // first operand is an address (label or number), jz/jnz add rs
+        char *address_str = lskip(first_space + 1);
+        if (*address_str == '\0') {
+            return asm_error(as, MINC_ERR_SYNTAX, "Missing address operand for '%s'", instruction);
+        }
+        if (desc->format == OPR_ADDR_RS) {
+            char *comma = find_comma(as, address_str, instruction);
+            if (comma == NULL) return 0;
+            char *operand = lskip(comma + 1);
+            int reg = strtol(operand + 1, NULL, 10);
+            if (!check_register_range(as, reg)) return 0;
+            opcode = opcode | reg;
+        }
+        if (*address_str == '_' || isalpha((unsigned char)*address_str)) {
+            if (!parse_label_operand(as, address_str, tok, sizeof(tok))) return 0;
+            label = tok; // emit placeholder; patch later
+        } else {
+            int addr = strtol(address_str, NULL, 0);
+            if (!check_immediate_range(as, addr)) return 0;
+            opcode = apply_fixup((uint16_t)opcode, desc->fixup, addr);
+        }
+        break;
+    }
+    case OPR_NONE:
+        break;
+    }
+
+    if (!codevec_push(&as->code, (uint16_t)opcode)) {
+        return asm_error(as, MINC_ERR_NOMEM, "out of memory");
+    }
+    if (label && !add_fixup(as, (int)(as->code.size - 1), label)) return 0;
+    (*instr_index)++;
+    return 1;
+}
+
+// Report the CPU time of the phase that just ended (--stats) and start the next
+static void end_phase(Assembler *as, const char *phase) {
+    clock_t now = clock();
+    if (as->stats && as->diag) {
+        fprintf(as->diag, "[Time]: %s %.6f s\n", phase, (double)(now - as->phase_start) / CLOCKS_PER_SEC);
+    }
+    as->phase_start = now;
+}
+
+static int assemble(Assembler *as, const char *src, size_t len) {
+    char line_to_assemble[256];
+    int instr_index = 0; // counts only real instructions
+
+    as->phase_start = clock();
+    size_t pos = 0;
+    while (pos < len) {
+        size_t end = pos;
+        while (end < len && src[end] != '\n') end++;
+        size_t n = end - pos;
+        if (n > 0 && src[end - 1] == '\r') n--; //改行コードを排除
+        if (n >= sizeof(line_to_assemble)) {
+            return asm_error(as, MINC_ERR_SYNTAX, "Line too long");
+        }
+        memcpy(line_to_assemble, src + pos, n);
+        line_to_assemble[n] = '\0';
+        if (!assemble_line(as, line_to_assemble, &instr_index)) return 0;
+        pos = end + 1;
+    }
+    end_phase(as, "assemble");
+
+    // resolve fixups
+    for (size_t i = 0; i < as->fix_size; i++) {
+        if (as->fix[i].sym->address < 0) {
+            return asm_error(as, MINC_ERR_UNDEFINED, "Undefined label '%s'", as->fix[i].sym->name);
+        }
+    }
+    Branch *br = (Branch *)calloc(as->fix_size ? as->fix_size : 1, sizeof(Branch));
+    if (!br) return asm_error(as, MINC_ERR_NOMEM, "out of memory");
+    for (size_t i = 0; i < as->fix_size; i++) {
+        br[i].index = as->fix[i].index;
+        br[i].target = as->fix[i].sym->address;
+    }
+    long size = relax_branches(br, as->fix_size, as->code.size);
+    if (size > MAX_PROGRAM_WORDS) {
+        free(br);
+        return asm_error(as, MINC_ERR_RANGE, "Program too large (%ld words, at most %d)", size, MAX_PROGRAM_WORDS);
+    }
+    uint16_t *data = (uint16_t *)malloc((size ? size : 1) * sizeof(uint16_t));
+    if (!data) {
+        free(br);
+        return asm_error(as, MINC_ERR_NOMEM, "out of memory");
+    }
+    place_branches(as->code.data, as->code.size, br, as->fix_size, data);
+    free(br);
+    free(as->code.data);
+    as->code.data = data;
+    as->code.size = as->code.cap = (size_t)size;
+    end_phase(as, "resolve");
+    return 1;
+}
+
+int minc_assemble_opts(const char *asm_text, size_t len, const MincOptions *opts, MincWords *words) {
+    words->data = NULL;
+    words->count = 0;
+    Assembler *as = (Assembler *)calloc(1, sizeof(Assembler));
+    if (!as) return MINC_ERR_NOMEM;
+    as->diag = opts->diag;
+    as->stats = opts->stats;
+    init_inst_hash(as);
+
+    if (assemble(as, asm_text, len)) {
+        words->data = as->code.data;
+        words->count = as->code.size;
+        as->code.data = NULL;
+    }
+    MincStatus status = as->status;
+
+    for (size_t i = 0; i < as->bucket_count; i++) {
+        Symbol *sym = as->buckets[i];
+        while (sym) {
+            Symbol *next = sym->next;
+            free(sym);
+            sym = next;
+        }
+    }
+    free(as->buckets);
+    free(as->fix);
+    free(as->code.data);
+    free(as);
+    return status;
+}
+
+int minc_assemble(const char *asm_text, size_t len, MincWords *words) {
+    MincOptions opts = {0};
+    opts.diag = stderr;
+    return minc_assemble_opts(asm_text, len, &opts, words);
+}
@@ -0,0 +1,52 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mincc.h"
+
+/***************************************************************
+Compilation-scoped arena
+
+Tokens, nodes and local variables live until the end of the
+compilation, so they are bump-allocated from large blocks and
+released together by arena_release().
+****************************************************************/
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN sizeof(void *)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t cap;
+    char data[];
+} ArenaBlock;
+
+// Allocate zero-initialized memory that lives until arena_release()
+void *arena_alloc(Compiler *cc, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (!cc->arena || cc->arena->cap - cc->arena->used < size) {
+        size_t cap = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        ArenaBlock *block = malloc(sizeof(ArenaBlock) + cap);
+        if (!block) {
+            error_nomem(cc);
+        }
+        block->next = cc->arena;
+        block->used = 0;
+        block->cap = cap;
+        cc->arena = block;
+    }
+    void *p = cc->arena->data + cc->arena->used;
+    cc->arena->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+// Free everything allocated by arena_alloc()
+void arena_release(Compiler *cc) {
+    while (cc->arena) {
+        ArenaBlock *next = cc->arena->next;
+        free(cc->arena);
+        cc->arena = next;
+    }
+}
@@ -7,13 +7,22 @@
 
 #include "mincc.h"
 
-Node code[256];
-
-LocalVar *local_vars = NULL;
+static Node *stmt(Compiler *cc, char *l);
+static Node *expr(Compiler *cc, char *l);
+static Node *assign(Compiler *cc, char *l);
+static Node *equality(Compiler *cc, char *l);
+static Node *relational(Compiler *cc, char *l);
+static Node *add(Compiler *cc, char *l);
+static Node *mul(Compiler *cc, char *l);
+static Node *unary(Compiler *cc, char *l);
+static Node *primary(Compiler *cc, char *l);
+static void generate(Compiler *cc, Node *node);
+static void generate_branch(Compiler *cc, Node *cond, const char *label, bool if_true);
+static void generate_prologue(Compiler *cc, long frame_slots);
 
 // Create new node (type != ND_NUM)
-Node *new_node(NodeType type, Node *lhs, Node *rhs, char *loc) {
-    Node *node = calloc(1, sizeof(Node));
+static Node *new_node(Compiler *cc, NodeType type, Node *lhs, Node *rhs, char *loc) {
+    Node *node = arena_alloc(cc, sizeof(Node));
     node->type = type;
     node->lhs = lhs;
     node->rhs = rhs;
@@ -22,45 +31,35 @@ Node *new_node(NodeType type, Node *lhs, Node *rhs, char *loc) {
 }
 
 // Create new node (type == ND_NUM)
-Node *new_num_node(long val, char *loc) {
-    Node *node = calloc(1, sizeof(Node));
+Node *new_num_node(Compiler *cc, long val, char *loc) {
+    Node *node = arena_alloc(cc, sizeof(Node));
     node->type = ND_NUM;
     node->val = val;
     node->loc = loc;
     return node;
 }
 
-Node *new_ident_node(char *name, long offset, char *loc) {
-    Node *node = calloc(1, sizeof(Node));
+static Node *new_ident_node(Compiler *cc, char *name, unsigned long name_len, long offset, char *loc) {
+    Node *node = arena_alloc(cc, sizeof(Node));
     node->type = ND_LOC_VAR;
     node->offset = offset;
-    node->name = mystrndup(name, strlen(name));
-    node->name_len = strlen(name);
+    node->name = name; // view into user_input
+    node->name_len = name_len;
     node->loc = loc;
     return node;
 }
 
-void print_node(Node *node) {
-    if (node->type == ND_NUM) {
-        printf("ND_NUM: %ld\n", node->val);
-    } else if (node->type == ND_LOC_VAR) {
-        printf("ND_LOC_VAR: %s\n", node->name);
-    } else {
-        printf("Node type: %d\n", node->type);
-        if (node->lhs) {
-            printf("LHS:\n");
-            print_node(node->lhs);
-        }
-        if (node->rhs) {
-            printf("RHS:\n");
-            print_node(node->rhs);
-        }
-    }
-}
-
 /***************************************************************
-program    = stmt*
-stmt       = expr ";" | "return" expr ";"
+program    = function* | stmt*
+function   = "int" ident "(" params? ")" ("{" stmt* "}" | ";")
+params     = "int" ident ("," "int" ident)*
+stmt       = expr? ";"
+           | "return" expr ";"
+           | "{" stmt* "}"
+           | "int" ident ("=" expr)? ";"
+           | "if" "(" expr ")" stmt ("else" stmt)?
+           | "while" "(" expr ")" stmt
+           | "for" "(" expr? ";" expr? ";" expr? ")" stmt
 expr       = assign
 assign     = equality ("=" assign)?
 equality   = relational ("==" relational | "!=" relational)*
@@ -68,250 +67,824 @@ relational = add ("<" add | "<=" add | ">" add | ">=" add)*
 add        = mul ("+" mul | "-" mul)*
 mul        = unary ("*" unary | "/" unary)*
 unary      = ("+" | "-")? primary
-primary    = num | ident | "(" expr ")"
+primary    = num | ident ("(" (expr ("," expr)*)? ")")? | "(" expr ")"
+
+A program without function definitions is the body of main.
 ****************************************************************/
 
-void program() {
-    long i = 0;
-    while (!at_eof()) {
-        code[i++] = *stmt(token->loc);
+static Function *find_function(Compiler *cc, Token *tok) {
+    for (Function *fn = cc->funcs; fn; fn = fn->next) {
+        if (fn->name_len == tok->size && memcmp(fn->name, tok->str, tok->size) == 0) {
+            return fn;
+        }
+    }
+    return NULL;
+}
+
+static Function *new_function(Compiler *cc, Token *tok) {
+    Function *fn = arena_alloc(cc, sizeof(Function));
+    fn->name = arena_alloc(cc, tok->size + 1);
+    memcpy(fn->name, tok->str, tok->size);
+    fn->name_len = tok->size;
+    fn->loc = tok->loc;
+    Function **p = &cc->funcs;
+    while (*p) {
+        p = &(*p)->next;
+    }
+    *p = fn;
+    return fn;
+}
+
+// Statements up to the closing "}" (or the end of input) in the current scope
+static Node *stmt_list(Compiler *cc, TokenKind end, char *loc) {
+    Node head = {0};
+    Node *cur = &head;
+    while (!(end == TK_NONE ? at_eof(cc) : consume(cc, end, loc))) {
+        if (at_eof(cc)) {
+            error_at(cc, MINC_ERR_SYNTAX, cc->token->loc, "Expected '}'");
+        }
+        cur = cur->next = stmt(cc, cc->token->loc);
+    }
+    Node *node = new_node(cc, ND_BLOCK, NULL, NULL, loc);
+    node->body = head.next;
+    return node;
+}
+
+// Parameters and body of fn up to end; save its locals for the code generator
+static void function_body(Compiler *cc, Function *fn, Token **params, TokenKind end, char *loc) {
+    cc->cur_func = fn;
+    reset_locals(cc);
+    enter_scope(cc);
+    for (int i = 0; i < fn->param_count; i++) {
+        fn->params[i] = add_local_var(cc, params[i]);
+    }
+    fn->body = stmt_list(cc, end, loc);
+    leave_scope(cc);
+    fn->locals = cc->local_vars;
+    fn->local_count = count_local_vars(cc);
+    fn->frame_slots = frame_size(cc);
+    cc->cur_func = NULL;
+}
+
+// "int" has been consumed
+static void function(Compiler *cc, char *loc) {
+    Token *name = cc->token;
+    expect_ident(cc, loc);
+    expect(cc, TK_LPAREN, loc);
+    Token *params[MAX_PARAMS];
+    int n = 0;
+    if (!consume(cc, TK_RPAREN, loc)) {
+        do {
+            expect(cc, TK_INT, loc);
+            if (n == MAX_PARAMS) {
+                error_at(cc, MINC_ERR_RANGE, cc->token->loc, "Too many parameters (at most %d)", MAX_PARAMS);
+            }
+            params[n++] = cc->token;
+            expect_ident(cc, loc);
+        } while (consume(cc, TK_COMMA, loc));
+        expect(cc, TK_RPAREN, loc);
+    }
+
+    Function *fn = find_function(cc, name);
+    if (!fn) {
+        fn = new_function(cc, name);
+        fn->param_count = n;
+    } else if (fn->param_count != n) {
+        error_at(cc, MINC_ERR_SYNTAX, name->loc, "Conflicting declaration of '%s'", fn->name);
+    }
+    if (consume(cc, TK_SEMICOLON, loc)) {
+        return; // declaration only
+    }
+    if (fn->body) {
+        error_at(cc, MINC_ERR_SYNTAX, name->loc, "Redefinition of '%s'", fn->name);
+    }
+    expect(cc, TK_LBRACE, loc);
+    function_body(cc, fn, params, TK_RBRACE, loc);
+}
+
+static bool at_function(Compiler *cc) {
+    Token *tok = cc->token;
+    return tok->kind == TK_INT && tok->next->type == TOKEN_IDENT && tok->next->next->kind == TK_LPAREN;
+}
+
+// Parse the whole input into a list of functions
+Function *program(Compiler *cc) {
+    char *loc = cc->token->loc;
+    if (!at_function(cc)) {
+        Token main_name = {.str = "main", .size = 4, .loc = loc};
+        function_body(cc, new_function(cc, &main_name), NULL, TK_NONE, loc);
+        return cc->funcs;
+    }
+
+    while (!at_eof(cc)) {
+        if (!at_function(cc)) {
+            error_at(cc, MINC_ERR_SYNTAX, cc->token->loc, "Expected a function definition");
+        }
+        consume(cc, TK_INT, loc);
+        function(cc, loc);
+    }
+    Token main_name = {.str = "main", .size = 4};
+    Function *main_fn = find_function(cc, &main_name);
+    if (!main_fn || !main_fn->body) {
+        error(cc, MINC_ERR_SYNTAX, "No definition of 'main'");
+    }
+    if (main_fn->param_count) {
+        error_at(cc, MINC_ERR_SYNTAX, main_fn->loc, "'main' takes no parameters");
+    }
+    for (Function *fn = cc->funcs; fn; fn = fn->next) {
+        if (fn->called && !fn->body) {
+            error_at(cc, MINC_ERR_SYNTAX, fn->loc, "'%s' is declared but never defined", fn->name);
+        }
     }
-    code[i] = *new_node(ND_EOF, NULL, NULL, token->loc);
+    return cc->funcs;
+}
+
+// "{" has been consumed; the block is a scope of its own
+static Node *compound_stmt(Compiler *cc, char *loc) {
+    enter_scope(cc);
+    Node *node = stmt_list(cc, TK_RBRACE, loc);
+    leave_scope(cc);
+    return node;
+}
 
-    generate_prologue(count_local_vars());
-    for (long j = 0; j < i; j++) {
-        generate(&code[j]);
+// "int" has been consumed. An initializer becomes an assignment.
+static Node *declaration(Compiler *cc, char *loc) {
+    Token *tok = cc->token;
+    char *name = expect_ident(cc, loc);
+    LocalVar *var = add_local_var(cc, tok);
+    Node *node = new_node(cc, ND_BLOCK, NULL, NULL, loc); // nothing to do
+    if (consume(cc, TK_ASSIGN, loc)) {
+        Node *lhs = new_ident_node(cc, name, tok->size, var->offset, tok->loc);
+        lhs->var = var;
+        var->uses++;
+        node = new_node(cc, ND_ASSIGN, lhs, assign(cc, loc), loc);
     }
+    expect(cc, TK_SEMICOLON, loc);
+    return node;
 }
 
-Node *stmt(char *l) {
+// Body of a loop: its variables count more for register allocation
+static Node *loop_body(Compiler *cc) {
+    cc->loop_depth++;
+    Node *node = stmt(cc, cc->token->loc);
+    cc->loop_depth--;
+    return node;
+}
+
+static Node *stmt(Compiler *cc, char *l) {
     Node *node;
     char *loc = l;
-    if (consume("return", loc)) {
-        node = new_node(ND_RETURN, expr(loc), NULL, loc);
-        expect(";", loc);
+    if (consume(cc, TK_RETURN, loc)) {
+        node = new_node(cc, ND_RETURN, expr(cc, loc), NULL, loc);
+        expect(cc, TK_SEMICOLON, loc);
+    } else if (consume(cc, TK_LBRACE, loc)) {
+        node = compound_stmt(cc, loc);
+    } else if (consume(cc, TK_INT, loc)) {
+        node = declaration(cc, loc);
+    } else if (consume(cc, TK_IF, loc)) {
+        node = new_node(cc, ND_IF, NULL, NULL, loc);
+        expect(cc, TK_LPAREN, loc);
+        node->cond = expr(cc, loc);
+        expect(cc, TK_RPAREN, loc);
+        node->then = stmt(cc, cc->token->loc);
+        if (consume(cc, TK_ELSE, loc)) {
+            node->els = stmt(cc, cc->token->loc);
+        }
+    } else if (consume(cc, TK_WHILE, loc)) {
+        node = new_node(cc, ND_WHILE, NULL, NULL, loc);
+        expect(cc, TK_LPAREN, loc);
+        cc->loop_depth++;
+        node->cond = expr(cc, loc);
+        cc->loop_depth--;
+        expect(cc, TK_RPAREN, loc);
+        node->body = loop_body(cc);
+    } else if (consume(cc, TK_FOR, loc)) {
+        node = new_node(cc, ND_FOR, NULL, NULL, loc);
+        expect(cc, TK_LPAREN, loc);
+        if (!consume(cc, TK_SEMICOLON, loc)) {
+            node->init = expr(cc, loc);
+            expect(cc, TK_SEMICOLON, loc);
+        }
+        cc->loop_depth++;
+        if (!consume(cc, TK_SEMICOLON, loc)) {
+            node->cond = expr(cc, loc);
+            expect(cc, TK_SEMICOLON, loc);
+        }
+        if (!consume(cc, TK_RPAREN, loc)) {
+            node->inc = expr(cc, loc);
+            expect(cc, TK_RPAREN, loc);
+        }
+        cc->loop_depth--;
+        node->body = loop_body(cc);
+    } else if (consume(cc, TK_SEMICOLON, loc)) {
+        node = new_node(cc, ND_BLOCK, NULL, NULL, loc); // empty statement
     } else {
-        node = expr(loc);
-        expect(";", loc);
+        node = expr(cc, loc);
+        expect(cc, TK_SEMICOLON, loc);
     }
     return node;
 }
 
-Node *expr(char *l) {
+static Node *expr(Compiler *cc, char *l) {
     char *loc = l;
-    Node *node = assign(loc);
+    Node *node = assign(cc, loc);
     return node;
 }
 
-Node *assign(char *l) {
+static Node *assign(Compiler *cc, char *l) {
     char *loc = l;
-    Node *node = equality(loc);
+    Node *node = equality(cc, loc);
 
-    if (consume("=", loc)) {
-        node = new_node(ND_ASSIGN, node, assign(loc), loc);
+    if (consume(cc, TK_ASSIGN, loc)) {
+        node = new_node(cc, ND_ASSIGN, node, assign(cc, loc), loc);
     }
     return node;
 }
 
-Node *equality(char *l) {
+static Node *equality(Compiler *cc, char *l) {
     char *loc = l;
-    Node *node = relational(loc);
+    Node *node = relational(cc, loc);
 
     while (true) {
-        if (consume("==", loc)) {
-            node = new_node(ND_EQ, node, relational(loc), loc);
-        } else if (consume("!=", loc)) {
-            node = new_node(ND_NEQ, node, relational(loc), loc);
+        if (consume(cc, TK_EQ, loc)) {
+            node = new_node(cc, ND_EQ, node, relational(cc, loc), loc);
+        } else if (consume(cc, TK_NE, loc)) {
+            node = new_node(cc, ND_NEQ, node, relational(cc, loc), loc);
         } else {
             return node;
         }
     }
 }
 
-Node *relational(char *l) {
+static Node *relational(Compiler *cc, char *l) {
     char *loc = l;
-    Node *node = add(loc);
+    Node *node = add(cc, loc);
 
     while (true) {
-        if (consume("<=", loc)) {
-            node = new_node(ND_GE, node, add(loc), loc);
-        } else if(consume(">=", loc)) {
-            node = new_node(ND_LE, node, add(loc), loc);
-        } else if (consume(">", loc)) {
-            node = new_node(ND_GT, node, add(loc), loc);
-        } else if (consume("<", loc)) {
-            node = new_node(ND_LT, node, add(loc), loc);
+        if (consume(cc, TK_LE, loc)) {
+            node = new_node(cc, ND_LE, node, add(cc, loc), loc);
+        } else if (consume(cc, TK_GE, loc)) {
+            node = new_node(cc, ND_GE, node, add(cc, loc), loc);
+        } else if (consume(cc, TK_GT, loc)) {
+            node = new_node(cc, ND_GT, node, add(cc, loc), loc);
+        } else if (consume(cc, TK_LT, loc)) {
+            node = new_node(cc, ND_LT, node, add(cc, loc), loc);
         } else {
             return node;
         }
     }
 }
 
-Node *add(char *l) {
+static Node *add(Compiler *cc, char *l) {
     char *loc = l;
-    Node *node = mul(loc);
+    Node *node = mul(cc, loc);
     
     while (true) {
-        if (consume("+", loc)) {
-            node = new_node(ND_ADD, node, mul(loc), loc);
-        } else if (consume("-", loc)) {
-            node = new_node(ND_SUB, node, mul(loc), loc);
+        if (consume(cc, TK_PLUS, loc)) {
+            node = new_node(cc, ND_ADD, node, mul(cc, loc), loc);
+        } else if (consume(cc, TK_MINUS, loc)) {
+            node = new_node(cc, ND_SUB, node, mul(cc, loc), loc);
         } else {
             return node;
         }
     }
 }
 
-Node *mul(char *l) {
+static Node *mul(Compiler *cc, char *l) {
     char *loc = l;
-    Node *node = unary(loc);
+    Node *node = unary(cc, loc);
 
     while (true) {
-        if (consume("*", loc)) {
-            node = new_node(ND_MUL, node, unary(loc), loc);
+        if (consume(cc, TK_STAR, loc)) {
+            node = new_node(cc, ND_MUL, node, unary(cc, loc), loc);
         } else {
             return node;
         }
     }
 }
 
-Node *primary(char *l) {       // primary = num | ident | "(" expr ")"
+// Function call: ident "(" args ")"
+static Node *call(Compiler *cc, char *loc) {
+    Token *tok = cc->token;
+    expect_ident(cc, loc);
+    expect(cc, TK_LPAREN, loc);
+    Node head = {0};
+    Node *cur = &head;
+    int n = 0;
+    if (!consume(cc, TK_RPAREN, loc)) {
+        do {
+            cur = cur->next = assign(cc, loc);
+            n++;
+        } while (consume(cc, TK_COMMA, loc));
+        expect(cc, TK_RPAREN, loc);
+    }
+
+    Function *fn = find_function(cc, tok);
+    if (!fn) {
+        error_at(cc, MINC_ERR_SYNTAX, tok->loc, "Undefined function '%.*s'", (int)tok->size, tok->str);
+    }
+    if (n != fn->param_count) {
+        error_at(cc, MINC_ERR_SYNTAX, tok->loc, "'%s' takes %d arguments, but %d were given", fn->name, fn->param_count, n);
+    }
+    fn->called = true;
+    cc->cur_func->has_calls = true;
+    Node *node = new_node(cc, ND_CALL, NULL, NULL, tok->loc);
+    node->func = fn;
+    node->args = head.next;
+    return node;
+}
+
+static Node *primary(Compiler *cc, char *l) {       // primary = num | ident | "(" expr ")"
     char *loc = l;
-    if (consume("(", loc)) { // かっこがあるなら、"(" expr ")"のはず
-        Node *node = expr(loc);
+    if (consume(cc, TK_LPAREN, loc)) { // かっこがあるなら、"(" expr ")"のはず
+        Node *node = expr(cc, loc);
 
-        expect(")", loc); // かっこは閉じられるはず...
+        expect(cc, TK_RPAREN, loc); // かっこは閉じられるはず...
         return node;
-    } else if (is_number_node()) {         // numの部分
-        return new_num_node(expect_number(loc), loc);
+    } else if (is_number_node(cc)) {         // numの部分
+        return new_num_node(cc, expect_number(cc, loc), loc);
+    } else if (cc->token->type == TOKEN_IDENT && cc->token->next->kind == TK_LPAREN) {
+        return call(cc, loc);
     } else {                               // identの部分
-        LocalVar *var = find_local_var(token);
-        Token *tok = token;
-        char *name = expect_ident(loc);
-        long offset;
-        if (var) {
-            offset = var->offset;
-            // fprintf(stderr, "Found local variable: %s at offset %ld\n", name, offset);
-        } else {
-            add_local_var(tok);
-            // fprintf(stderr, "Added local variable: %s at offset %ld\n", name, local_vars->offset);
-            offset = local_vars->offset;
+        LocalVar *var = find_local_var(cc, cc->token);
+        Token *tok = cc->token;
+        char *name = expect_ident(cc, loc);
+        if (!var) {
+            var = add_implicit_var(cc, tok);
         }
-        return new_ident_node(name, offset, loc);
+        // A reference inside a loop weighs 8 per nesting level (capped)
+        var->uses += 1L << (3 * (cc->loop_depth < 4 ? cc->loop_depth : 4));
+        Node *node = new_ident_node(cc, name, tok->size, var->offset, loc);
+        node->var = var;
+        return node;
     }
 }
 
-Node *unary(char *l) {
+static Node *unary(Compiler *cc, char *l) {
     char *loc = l;
-    if (consume("+", loc)) {
-        return new_node(ND_ADD, new_num_node(0, loc), unary(loc), loc);
-    } else if (consume("-", loc)) {
-        return new_node(ND_SUB, new_num_node(0, loc), unary(loc), loc);
+    if (consume(cc, TK_PLUS, loc)) {
+        return new_node(cc, ND_ADD, new_num_node(cc, 0, loc), unary(cc, loc), loc);
+    } else if (consume(cc, TK_MINUS, loc)) {
+        return new_node(cc, ND_SUB, new_num_node(cc, 0, loc), unary(cc, loc), loc);
     } else {
-        return primary(loc);
+        return primary(cc, loc);
     }
 }
 
-LocalVar *find_local_var(Token *tok) {
-    LocalVar *var = local_vars;
-    while (var) {
-        // fprintf(stderr, "Comparing %s with %s\n", var->name, tok->str);
-        if (strcmp(var->name, tok->str) == 0) {
-            return var;
+/***************************************************************
+Statements
+
+Both code generators share the control-flow layout below and only
+differ in how expressions, returns and conditional branches are
+generated.
+
+  if (c) A            jump to Lend if !c; A; Lend:
+  if (c) A else B     jump to Lelse if !c; A; goto Lend; Lelse: B; Lend:
+  while (c) A         jump to Lend if !c; Ltop: A; jump to Ltop if c; Lend:
+  for (i; c; n) A     i; jump to Lend if !c; Ltop: A; n; jump to Ltop if c; Lend:
+
+The condition is tested once on entry and then at the bottom of the
+loop, so each iteration costs a single jz/jnz. Conditions branch on
+the comparison result directly (see generate_branch). There is no
+unconditional jump, so "goto L" is "mvi r0,0; jz L,r0": no
+temporaries are live between statements.
+****************************************************************/
+
+static const char *new_label(Compiler *cc) {
+    char *name = arena_alloc(cc, 24);
+    snprintf(name, 24, "_L%ld", cc->label_count++);
+    return name;
+}
+
+static void gen_goto(Compiler *cc, const char *label) {
+    emit(cc, I_MVI, 0, 0, 0);
+    emit_jump(cc, I_JZ, label, 0);
+}
+
+static void gen_branch(Compiler *cc, Node *cond, const char *label, bool if_true) {
+    if (cond->type == ND_NUM) {
+        if ((cond->val != 0) == if_true) {
+            gen_goto(cc, label);
         }
-        var = var->next;
+        return;
+    }
+    if (cc->opt_regalloc) {
+        generate_branch_reg(cc, cond, label, if_true);
+    } else {
+        generate_branch(cc, cond, label, if_true);
     }
-    return NULL;
 }
 
-void add_local_var(Token *tok) {
-    LocalVar *var = calloc(1, sizeof(LocalVar));
-    var->name_len = tok->size;
-    var->name = mystrndup(tok->str, tok->size);
-    var->offset = (local_vars ? local_vars->offset - 1 : -1);
-    var->next = local_vars;
-    local_vars = var;
+// True if control never reaches the end of node
+static bool ends_with_return(Node *node) {
+    switch (node->type) {
+    case ND_RETURN:
+        return true;
+    case ND_BLOCK: {
+        Node *last = node->body;
+        while (last && last->next) {
+            last = last->next;
+        }
+        return last && ends_with_return(last);
+    }
+    case ND_IF:
+        return node->els && ends_with_return(node->then) && ends_with_return(node->els);
+    case ND_WHILE:
+    case ND_FOR: // there is no break: only return leaves an endless loop
+        return !node->cond || (node->cond->type == ND_NUM && node->cond->val != 0);
+    default:
+        return false;
+    }
 }
 
-long count_local_vars() {
-    long count = 0;
-    LocalVar *var = local_vars;
-    while (var) {
-        count++;
-        var = var->next;
+static void gen_stmt(Compiler *cc, Node *node);
+
+// Loop body followed by the bottom test; cond NULL loops forever
+static void gen_loop(Compiler *cc, Node *cond, Node *body, Node *inc) {
+    if (cond && cond->type == ND_NUM && cond->val == 0) {
+        return; // never entered
+    }
+    const char *top = new_label(cc);
+    const char *end = new_label(cc);
+    if (cond) {
+        gen_branch(cc, cond, end, false);
     }
-    return count;
+    emit_label(cc, top);
+    gen_stmt(cc, body);
+    if (inc) {
+        gen_stmt(cc, inc);
+    }
+    if (cond) {
+        gen_branch(cc, cond, top, true);
+    } else {
+        gen_goto(cc, top);
+    }
+    emit_label(cc, end);
+}
+
+static void gen_stmt(Compiler *cc, Node *node) {
+    switch (node->type) {
+    case ND_BLOCK:
+        for (Node *n = node->body; n; n = n->next) {
+            gen_stmt(cc, n);
+        }
+        return;
+    case ND_IF: {
+        if (node->cond->type == ND_NUM) {
+            // Only the branch that is taken
+            Node *taken = node->cond->val ? node->then : node->els;
+            if (taken) {
+                gen_stmt(cc, taken);
+            }
+            return;
+        }
+        const char *end = new_label(cc);
+        if (!node->els) {
+            gen_branch(cc, node->cond, end, false);
+            gen_stmt(cc, node->then);
+        } else {
+            const char *els = new_label(cc);
+            gen_branch(cc, node->cond, els, false);
+            gen_stmt(cc, node->then);
+            if (!ends_with_return(node->then)) {
+                gen_goto(cc, end);
+            }
+            emit_label(cc, els);
+            gen_stmt(cc, node->els);
+        }
+        emit_label(cc, end);
+        return;
+    }
+    case ND_WHILE:
+        gen_loop(cc, node->cond, node->body, NULL);
+        return;
+    case ND_FOR:
+        if (node->init) {
+            gen_stmt(cc, node->init);
+        }
+        gen_loop(cc, node->cond, node->body, node->inc);
+        return;
+    default:
+        break;
+    }
+
+    // return or expression statement
+    if (cc->opt_regalloc) {
+        generate_reg(cc, node);
+    } else {
+        generate(cc, node);
+        if (node->type != ND_RETURN) {
+            emit(cc, I_POP, 0, 0, 0); // discard the value of an expression statement
+        }
+    }
+}
+
+static void gen_function(Compiler *cc, Function *fn) {
+    cc->cur_func = fn;
+    emit_label(cc, fn->name);
+    generate_prologue(cc, cc->opt_regalloc ? assign_local_regs(cc, fn) : fn->frame_slots);
+    gen_stmt(cc, fn->body);
+    if (!ends_with_return(fn->body)) {
+        // Falling off the end returns 0
+        gen_stmt(cc, new_node(cc, ND_RETURN, new_num_node(cc, 0, fn->loc), NULL, fn->loc));
+    }
+    cc->cur_func = NULL;
 }
 
-void generate_prologue(long local_var_count) {
-    printf("push r15\n");
-    printf("lds r15\n");
-    printf("mvi r0,%ld\n", -local_var_count);  // ローカル変数の分の領域を確保
-    printf("add r0,r15\n");
-    printf("sts r0\n");
+/***************************************************************
+Multiplication without mul (-mno-mul)
+
+x * c is an add chain over the signed binary digits of c (non-
+adjacent form, modulo 256), most significant first:
+
+    acc = x or -x; for each lower digit: acc += acc, then acc += x,
+    acc -= x or nothing.
+
+x * y calls MUL_ROUTINE, which is emitted once after the functions.
+It scans y from the top bit down: lt against 128 tests the top bit
+and y + y shifts it out.
+****************************************************************/
+
+// Signed digits (-1, 0, 1) of c modulo 256, least significant first.
+// Return the number of digits up to the top nonzero one.
+int mul_digits(long c, int *digits) {
+    int n = 0;
+    c &= 0xFF;
+    for (int i = 0; i < 8; i++) {
+        int d = 0;
+        if (c & 1) {
+            d = 2 - (int)(c & 3); // 1 if c mod 4 == 1, -1 if 3
+            c -= d;
+        }
+        digits[i] = d;
+        c >>= 1;
+        if (d) {
+            n = i + 1;
+        }
+    }
+    return n;
 }
 
-void generate_epilogue() {
-    printf("pop r0\n");
-    printf("sts r15\n");
-    printf("pop r15\n");
-    printf("ret\n");
+// Pops x, pushes x * c
+static void gen_mul_const(Compiler *cc, long c) {
+    int digits[8];
+    int n = mul_digits(c, digits);
+    emit(cc, I_POP, 1, 0, 0);
+    if (n == 0) {
+        emit(cc, I_MVI, 0, 0, 0);
+    } else if (digits[n - 1] > 0) {
+        emit(cc, I_MOV, 0, 1, 0);
+    } else {
+        emit(cc, I_MVI, 0, 0, 0);
+        emit(cc, I_SUB, 0, 1, 0);
+    }
+    for (int i = n - 2; i >= 0; i--) {
+        emit(cc, I_ADD, 0, 0, 0);
+        if (digits[i]) {
+            emit(cc, digits[i] > 0 ? I_ADD : I_SUB, 0, 1, 0);
+        }
+    }
+    emit(cc, I_PUSH, 0, 0, 0);
 }
 
-void generate(Node *node) {
+static void gen_mul_routine(Compiler *cc) {
+    emit_label(cc, MUL_ROUTINE);
+    emit(cc, I_MVI, 0, 0, 0);   // product
+    emit(cc, I_MVI, 3, 0, 1);   // loop counter: doubles until it wraps to 0
+    emit(cc, I_MVI, 4, 0, 128);
+    emit_label(cc, MUL_ROUTINE "_loop");
+    emit(cc, I_ADD, 0, 0, 0);
+    emit(cc, I_MOV, 5, 2, 0);
+    emit(cc, I_LT, 5, 4, 0);    // top bit of r2 clear?
+    emit_jump(cc, I_JNZ, MUL_ROUTINE "_skip", 5);
+    emit(cc, I_ADD, 0, 1, 0);
+    emit_label(cc, MUL_ROUTINE "_skip");
+    emit(cc, I_ADD, 2, 2, 0);
+    emit(cc, I_ADD, 3, 3, 0);
+    emit_jump(cc, I_JNZ, MUL_ROUTINE "_loop", 3);
+    emit(cc, I_RET, 0, 0, 0);
+}
+
+// Generate every defined function, in definition order, then the
+// runtime routines they use
+void generate_program(Compiler *cc, Function *funcs) {
+    for (Function *fn = funcs; fn; fn = fn->next) {
+        if (fn->body) {
+            gen_function(cc, fn);
+        }
+    }
+    if (cc->uses_mul_routine) {
+        gen_mul_routine(cc);
+    }
+}
+
+// Save the callee-saved registers, set up the frame if there are
+// frame slots, and move the arguments to their locals
+static void generate_prologue(Compiler *cc, long frame_slots) {
+    Function *fn = cc->cur_func;
+    int saved = 0;
+    for (int r = FIRST_CALLEE_SAVED; r < 15; r++) {
+        if (fn->saved_regs & (1u << r)) {
+            emit(cc, I_PUSH, 0, r, 0);
+            saved++;
+        }
+    }
+    if (cc->opt_stats && cc->diag) {
+        fprintf(cc->diag, "[Stats]: %s: frame %ld, saved %d\n", fn->name, frame_slots, saved);
+    }
+    long max_slots = RAM_BYTES - FRAME_OVERHEAD - saved;
+    if (frame_slots > max_slots) {
+        error_at(cc, MINC_ERR_RANGE, fn->loc, "Too many local variables in '%s' (%ld frame slots, at most %ld)", fn->name, frame_slots, max_slots);
+    }
+    fn->has_frame = frame_slots > 0;
+    if (fn->has_frame) {
+        emit(cc, I_PUSH, 0, 15, 0);
+        emit(cc, I_LDS, 15, 0, 0);
+        emit(cc, I_MVI, 0, 0, -frame_slots);  // ローカル変数の分の領域を確保
+        emit(cc, I_ADD, 0, 15, 0);
+        emit(cc, I_STS, 0, 0, 0);
+    }
+    for (int i = 0; i < fn->param_count; i++) {
+        LocalVar *var = fn->params[i];
+        if (var->reg >= 0) {
+            emit(cc, I_MOV, var->reg, i + 1, 0);
+        } else {
+            emit(cc, I_STM, 0, i + 1, var->offset);
+        }
+    }
+}
+
+// Return with the value in r0
+void generate_epilogue(Compiler *cc) {
+    Function *fn = cc->cur_func;
+    if (fn->has_frame) {
+        emit(cc, I_STS, 0, 15, 0);
+        emit(cc, I_POP, 15, 0, 0);
+    }
+    for (int r = 14; r >= FIRST_CALLEE_SAVED; r--) {
+        if (fn->saved_regs & (1u << r)) {
+            emit(cc, I_POP, r, 0, 0);
+        }
+    }
+    emit(cc, I_RET, 0, 0, 0);
+}
+
+// Jump to label if cond is true (if_true) or false, otherwise fall through.
+// Comparisons branch on the result of lt/sub instead of a pushed 0/1.
+static void generate_branch(Compiler *cc, Node *cond, const char *label, bool if_true) {
+    InstOp jump_true = I_JNZ, jump_false = I_JZ;
+    int reg = 0; // register holding the condition
+    switch (cond->type) {
+    case ND_EQ:
+    case ND_NEQ:
+    case ND_LT:
+    case ND_LE:
+    case ND_GT:
+    case ND_GE:
+        generate(cc, cond->lhs);
+        generate(cc, cond->rhs);
+        emit(cc, I_POP, 1, 0, 0);
+        emit(cc, I_POP, 0, 0, 0);
+        switch (cond->type) {
+        case ND_EQ:  // r0-r1 == 0
+            emit(cc, I_SUB, 0, 1, 0);
+            jump_true = I_JZ, jump_false = I_JNZ;
+            break;
+        case ND_NEQ:
+            emit(cc, I_SUB, 0, 1, 0);
+            break;
+        case ND_LT:
+            emit(cc, I_LT, 0, 1, 0);
+            break;
+        case ND_GE:  // !(r0 < r1)
+            emit(cc, I_LT, 0, 1, 0);
+            jump_true = I_JZ, jump_false = I_JNZ;
+            break;
+        case ND_GT:  // r1 < r0
+            emit(cc, I_LT, 1, 0, 0);
+            reg = 1;
+            break;
+        default:     // ND_LE: !(r1 < r0)
+            emit(cc, I_LT, 1, 0, 0);
+            reg = 1;
+            jump_true = I_JZ, jump_false = I_JNZ;
+            break;
+        }
+        break;
+    default:
+        generate(cc, cond);
+        emit(cc, I_POP, 0, 0, 0);
+        break;
+    }
+    emit_jump(cc, if_true ? jump_true : jump_false, label, reg);
+}
+
+static void generate(Compiler *cc, Node *node) {
     if(node->type == ND_NUM) {
-        printf("mvi r0,%ld\npush r0\n", node->val);
+        emit(cc, I_MVI, 0, 0, node->val);
+        emit(cc, I_PUSH, 0, 0, 0);
         return;
     } else if (node->type == ND_LOC_VAR) {
-        printf("ldm r0,%ld\npush r0\n", node->offset);
+        emit(cc, I_LDM, 0, 0, node->offset);
+        emit(cc, I_PUSH, 0, 0, 0);
         return;
     } else if (node->type == ND_ASSIGN) {
-        generate(node->rhs);
+        generate(cc, node->rhs);
         if (node->lhs->type != ND_LOC_VAR) {
-            error_at(node->lhs->loc, "Left-hand side of assignment must be a variable");
+            error_at(cc, MINC_ERR_SYNTAX, node->lhs->loc, "Left-hand side of assignment must be a variable");
         }
-        printf("pop r0\nstm %ld,r0\n", node->lhs->offset);
+        emit(cc, I_POP, 0, 0, 0);
+        emit(cc, I_STM, 0, 0, node->lhs->offset);
+        emit(cc, I_PUSH, 0, 0, 0); // the value of the assignment
         return;
     } else if (node->type == ND_RETURN) {
-        generate(node->lhs);
-        generate_epilogue();
+        generate(cc, node->lhs);
+        emit(cc, I_POP, 0, 0, 0);
+        generate_epilogue(cc);
+        return;
+    } else if (node->type == ND_CALL) {
+        // Nothing is live in registers: pop the arguments into r1..
+        int n = 0;
+        for (Node *arg = node->args; arg; arg = arg->next) {
+            generate(cc, arg);
+            n++;
+        }
+        for (int r = n; r >= 1; r--) {
+            emit(cc, I_POP, r, 0, 0);
+        }
+        emit_jump(cc, I_CALL, node->func->name, 0);
+        emit(cc, I_PUSH, 0, 0, 0);
+        return;
+    } else if (node->type == ND_MUL && cc->opt_no_mul) {
+        if (node->rhs->type == ND_NUM || node->lhs->type == ND_NUM) {
+            bool rhs_num = node->rhs->type == ND_NUM;
+            generate(cc, rhs_num ? node->lhs : node->rhs);
+            gen_mul_const(cc, rhs_num ? node->rhs->val : node->lhs->val);
+            return;
+        }
+        generate(cc, node->lhs);
+        generate(cc, node->rhs);
+        emit(cc, I_POP, 2, 0, 0);
+        emit(cc, I_POP, 1, 0, 0);
+        emit_jump(cc, I_CALL, MUL_ROUTINE, 0);
+        emit(cc, I_PUSH, 0, 0, 0);
+        cc->uses_mul_routine = true;
         return;
     }
     
 
-    generate(node->lhs);
-    generate(node->rhs);
+    generate(cc, node->lhs);
+    generate(cc, node->rhs);
 
+    emit(cc, I_POP, 1, 0, 0);
+    emit(cc, I_POP, 0, 0, 0);
     switch (node->type) {
     case ND_ADD:
-        printf("pop r1\npop r0\nadd r0,r1\npush r0\n");
+        emit(cc, I_ADD, 0, 1, 0);
+        emit(cc, I_PUSH, 0, 0, 0);
         break;
     case ND_SUB:
-        printf("pop r1\npop r0\nsub r0,r1\npush r0\n");
+        emit(cc, I_SUB, 0, 1, 0);
+        emit(cc, I_PUSH, 0, 0, 0);
         break;
     case ND_MUL:
-        printf("pop r1\npop r0\nmul r0,r1\npush r0\n");
+        emit(cc, I_MUL, 0, 1, 0);
+        emit(cc, I_PUSH, 0, 0, 0);
         break;
     case ND_EQ:
-        printf("pop r1\npop r0\nsub r0,r1\nmvi r2,1\nlt r0,r2\npush r0\n");
+        emit(cc, I_SUB, 0, 1, 0);
+        emit(cc, I_MVI, 2, 0, 1);
+        emit(cc, I_LT, 0, 2, 0);
+        emit(cc, I_PUSH, 0, 0, 0);
         break;
     case ND_NEQ:
-        printf("pop r1\npop r0\nsub r0,r1\nmvi r2,0\nlt r2,r0\npush r2\n");
+        emit(cc, I_SUB, 0, 1, 0);
+        emit(cc, I_MVI, 2, 0, 0);
+        emit(cc, I_LT, 2, 0, 0);
+        emit(cc, I_PUSH, 0, 2, 0);
         break;
     case ND_LT:
-        printf("pop r1\npop r0\nlt r0,r1\npush r0\n");
+        emit(cc, I_LT, 0, 1, 0);
+        emit(cc, I_PUSH, 0, 0, 0);
         break;
     case ND_LE:
-        printf("pop r1\npop r0\nlt r1,r0\nmvi r2,1\nlt r1,r2\npush r1\n");
+        emit(cc, I_LT, 1, 0, 0);
+        emit(cc, I_MVI, 2, 0, 1);
+        emit(cc, I_LT, 1, 2, 0);
+        emit(cc, I_PUSH, 0, 1, 0);
         break;
     case ND_GT:
-        printf("pop r1\npop r0\nlt r1,r0\npush r1\n");
+        emit(cc, I_LT, 1, 0, 0);
+        emit(cc, I_PUSH, 0, 1, 0);
         break;
     case ND_GE:
-        printf("pop r1\npop r0\nlt r0,r1\nmvi r2,1\nlt r0,r2\npush r0\n");
+        emit(cc, I_LT, 0, 1, 0);
+        emit(cc, I_MVI, 2, 0, 1);
+        emit(cc, I_LT, 0, 2, 0);
+        emit(cc, I_PUSH, 0, 0, 0);
         break;
     default:
-        error_at(node->loc, "Unknown node type");
+        error_at(cc, MINC_ERR_INTERNAL, node->loc, "Unknown node type");
         break;
     }
 }
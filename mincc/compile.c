@@ -0,0 +1,291 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mincc.h"
+
+/***************************************************************
+Library entry point
+
+minc_compile_opts() runs one compilation in a fresh Compiler.
+error() and friends print to cc->diag and longjmp back here, so the
+caller gets a status instead of an exit, and everything the
+compilation allocated is released on both paths.
+****************************************************************/
+
+static void index_lines(Compiler *cc, long size) {
+    long cap = 256;
+    cc->line_starts = malloc(cap * sizeof(long));
+    if (!cc->line_starts) {
+        error_nomem(cc);
+    }
+    cc->line_count = 0;
+    cc->line_starts[cc->line_count++] = 0;
+    for (long i = 0; i < size; i++) {
+        if (cc->user_input[i] == '\n') {
+            if (cc->line_count == cap) {
+                cap *= 2;
+                long *new_starts = realloc(cc->line_starts, cap * sizeof(long));
+                if (!new_starts) {
+                    error_nomem(cc);
+                }
+                cc->line_starts = new_starts;
+            }
+            cc->line_starts[cc->line_count++] = i + 1;
+        }
+    }
+}
+
+// Line index (0-based) of loc by binary search
+static long find_line(Compiler *cc, char *loc) {
+    long pos = loc - cc->user_input;
+    long lo = 0, hi = cc->line_count - 1;
+    while (lo < hi) {
+        long mid = (lo + hi + 1) / 2;
+        if (cc->line_starts[mid] <= pos) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+// Print "name:line:col:" and the source line, indented by indent columns.
+// Return the column (0-based) of loc.
+static int print_source_line(Compiler *cc, char *loc, int indent) {
+    long line = find_line(cc, loc);
+    char *start = cc->user_input + cc->line_starts[line];
+    char *end = start;
+    while (*end && *end != '\n' && *end != '\r') {
+        end++;
+    }
+    int col = (int)(loc - start);
+    fprintf(cc->diag, "%s:%ld:%d:\n", cc->input_name, line + 1, col + 1);
+    fprintf(cc->diag, "%*s%.*s\n", indent, "", (int)(end - start), start);
+    return col;
+}
+
+static void bail(Compiler *cc, MincStatus status) {
+    cc->status = status;
+    longjmp(cc->bail, 1);
+}
+
+// Throw an error message and abandon the compilation with status
+// (MINC_ERR_INTERNAL only for broken compiler invariants)
+void error(Compiler *cc, MincStatus status, const char *fmt, ...) {
+    if (cc->diag) {
+        va_list ap;
+        va_start(ap, fmt);
+        fprintf(cc->diag, "[Error]: ");
+        vfprintf(cc->diag, fmt, ap);
+        fprintf(cc->diag, "\n");
+        va_end(ap);
+    }
+    bail(cc, status);
+}
+
+void error_at(Compiler *cc, MincStatus status, char *loc, const char *fmt, ...) {
+    if (cc->diag) {
+        va_list ap;
+        va_start(ap, fmt);
+        int pos = print_source_line(cc, loc, 9);
+        fprintf(cc->diag, "[Error]: ");
+        fprintf(cc->diag, "%*s", pos, ""); // pos個の空白を出力
+        fprintf(cc->diag, "^ ");
+        vfprintf(cc->diag, fmt, ap);
+        fprintf(cc->diag, "\n");
+        va_end(ap);
+    }
+    bail(cc, status);
+}
+
+void error_nomem(Compiler *cc) {
+    if (cc->diag) {
+        fprintf(cc->diag, "[Error]: Memory allocation failed\n");
+    }
+    bail(cc, MINC_ERR_NOMEM);
+}
+
+void warn(Compiler *cc, const char *fmt, ...) {
+    if (!cc->diag) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(cc->diag, "[Warning]: ");
+    vfprintf(cc->diag, fmt, ap);
+    fprintf(cc->diag, "\n");
+    va_end(ap);
+}
+
+void warn_at(Compiler *cc, char *loc, const char *fmt, ...) {
+    if (!cc->diag) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int pos = print_source_line(cc, loc, 11);
+    fprintf(cc->diag, "[Warning]: ");
+    fprintf(cc->diag, "%*s", pos, ""); // pos個の空白を出力
+    fprintf(cc->diag, "^ ");
+    vfprintf(cc->diag, fmt, ap);
+    fprintf(cc->diag, "\n");
+    va_end(ap);
+}
+
+// Append formatted text to the assembly output
+void out_printf(Compiler *cc, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(cc->out + cc->out_len, cc->out_cap - cc->out_len, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        error(cc, MINC_ERR_INTERNAL, "Output formatting failed");
+    }
+    if (cc->out_len + n + 1 > cc->out_cap) {
+        size_t cap = cc->out_cap ? cc->out_cap : 4096;
+        while (cap < cc->out_len + n + 1) {
+            cap *= 2;
+        }
+        char *out = realloc(cc->out, cap);
+        if (!out) {
+            error_nomem(cc);
+        }
+        cc->out = out;
+        cc->out_cap = cap;
+        va_start(ap, fmt);
+        vsnprintf(cc->out + cc->out_len, cc->out_cap - cc->out_len, fmt, ap);
+        va_end(ap);
+    }
+    cc->out_len += n;
+}
+
+// Report the CPU time of the phase that just ended (--stats) and start the next
+static void end_phase(Compiler *cc, const char *phase) {
+    clock_t now = clock();
+    if (cc->opt_stats && cc->diag) {
+        fprintf(cc->diag, "[Time]: %s %.6f s\n", phase, (double)(now - cc->phase_start) / CLOCKS_PER_SEC);
+    }
+    cc->phase_start = now;
+}
+
+static void compile(Compiler *cc, const char *src, size_t len) {
+    cc->phase_start = clock();
+    cc->user_input = malloc(len + 1);
+    if (!cc->user_input) {
+        error_nomem(cc);
+    }
+    memcpy(cc->user_input, src, len);
+    cc->user_input[len] = '\0';
+    index_lines(cc, (long)len);
+    if (cc->opt_verbose && cc->diag) {
+        fprintf(cc->diag, "Input code: %s\n", cc->user_input);
+    }
+
+    cc->token = tokenize(cc, cc->user_input);
+    end_phase(cc, "tokenize");
+
+    emit_jump(cc, I_CALL, "main", 0);
+    emit(cc, I_PUSH, 0, 0, 0);
+    emit(cc, I_HALT, 0, 0, 0);
+    Function *funcs = program(cc);
+    end_phase(cc, "parse");
+    if (cc->opt_level >= 1) {
+        for (Function *fn = funcs; fn; fn = fn->next) {
+            if (fn->body) {
+                fn->body = fold(cc, fn->body);
+            }
+        }
+        end_phase(cc, "fold");
+    }
+    generate_program(cc, funcs);
+    end_phase(cc, "codegen");
+
+    if (cc->opt_level >= 1) {
+        peephole(cc);
+        end_phase(cc, "peephole");
+    }
+}
+
+static Compiler *new_compiler(const MincOptions *opts) {
+    Compiler *cc = calloc(1, sizeof(Compiler));
+    if (!cc) {
+        return NULL;
+    }
+    cc->opt_level = opts->opt_level;
+    cc->opt_regalloc = opts->regalloc || opts->opt_level >= 2;
+    cc->opt_verbose = opts->verbose;
+    cc->opt_no_mul = opts->no_mul;
+    cc->opt_stats = opts->stats;
+    cc->diag = opts->diag;
+    cc->input_name = opts->input_name ? opts->input_name : "<stdin>";
+    return cc;
+}
+
+static MincStatus free_compiler(Compiler *cc) {
+    MincStatus status = cc->status;
+    arena_release(cc);
+    free(cc->buckets);
+    free(cc->insts);
+    free(cc->line_starts);
+    free(cc->user_input);
+    free(cc->out);
+    free(cc->code);
+    free(cc);
+    return status;
+}
+
+int minc_compile_opts(const char *src, size_t len, const MincOptions *opts, char **asm_buf) {
+    *asm_buf = NULL;
+    Compiler *cc = new_compiler(opts);
+    if (!cc) {
+        return MINC_ERR_NOMEM;
+    }
+    if (setjmp(cc->bail) == 0) {
+        compile(cc, src, len);
+        print_insts(cc);
+        end_phase(cc, "emit");
+        *asm_buf = cc->out;
+        cc->out = NULL;
+    }
+    return free_compiler(cc);
+}
+
+int minc_compile_words(const char *src, size_t len, const MincOptions *opts, MincWords *words) {
+    words->data = NULL;
+    words->count = 0;
+    Compiler *cc = new_compiler(opts);
+    if (!cc) {
+        return MINC_ERR_NOMEM;
+    }
+    if (setjmp(cc->bail) == 0) {
+        compile(cc, src, len);
+        encode_insts(cc);
+        end_phase(cc, "encode");
+        words->data = cc->code;
+        words->count = cc->code_count;
+        cc->code = NULL;
+    }
+    return free_compiler(cc);
+}
+
+int minc_compile(const char *src, size_t len, char **asm_buf) {
+    MincOptions opts = {0};
+    opts.diag = stderr;
+    return minc_compile_opts(src, len, &opts, asm_buf);
+}
+
+const char *minc_strerror(int status) {
+    switch (status) {
+    case MINC_OK:            return "success";
+    case MINC_ERR_SYNTAX:    return "syntax error";
+    case MINC_ERR_RANGE:     return "value out of range";
+    case MINC_ERR_UNDEFINED: return "undefined or duplicate label";
+    case MINC_ERR_NOMEM:     return "out of memory";
+    case MINC_ERR_INTERNAL:  return "internal error";
+    default:                 return "unknown error";
+    }
+}
@@ -0,0 +1,138 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "mincc.h"
+
+/***************************************************************
+Constant folding and algebraic simplification (-O1 and above)
+
+Values are 8-bit and wrap around like the CPU registers; lt is an
+unsigned compare (the borrow of rd - rs).
+****************************************************************/
+
+static bool is_num(Node *node, long val) {
+    return node->type == ND_NUM && node->val == val;
+}
+
+// True if evaluating node may change a variable
+static bool has_side_effects(Node *node) {
+    if (!node) {
+        return false;
+    }
+    if (node->type == ND_ASSIGN || node->type == ND_CALL) {
+        return true;
+    }
+    return has_side_effects(node->lhs) || has_side_effects(node->rhs);
+}
+
+// Evaluate a binary operator on 8-bit operands
+static long eval(Compiler *cc, NodeType type, long a, long b) {
+    switch (type) {
+    case ND_ADD: return (a + b) & 0xFF;
+    case ND_SUB: return (a - b) & 0xFF;
+    case ND_MUL: return (a * b) & 0xFF;
+    case ND_EQ:  return a == b;
+    case ND_NEQ: return a != b;
+    case ND_LT:  return a < b;
+    case ND_LE:  return a <= b;
+    case ND_GT:  return a > b;
+    case ND_GE:  return a >= b;
+    default:
+        error(cc, MINC_ERR_INTERNAL, "Cannot fold node type %d", type);
+        return 0;
+    }
+}
+
+Node *fold(Compiler *cc, Node *node) {
+    if (node->type == ND_NUM) {
+        node->val &= 0xFF;
+        return node;
+    }
+    if (node->type == ND_LOC_VAR) {
+        return node;
+    }
+    if (node->type == ND_BLOCK || node->type == ND_CALL) {
+        Node **list = node->type == ND_BLOCK ? &node->body : &node->args;
+        for (Node **stmt = list; *stmt; stmt = &(*stmt)->next) {
+            Node *next = (*stmt)->next;
+            *stmt = fold(cc, *stmt);
+            (*stmt)->next = next;
+        }
+        return node;
+    }
+    if (node->type == ND_IF || node->type == ND_WHILE || node->type == ND_FOR) {
+        Node **parts[] = {&node->init, &node->cond, &node->inc, &node->then, &node->els, &node->body};
+        for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+            if (*parts[i]) {
+                Node *next = (*parts[i])->next;
+                *parts[i] = fold(cc, *parts[i]);
+                (*parts[i])->next = next;
+            }
+        }
+        return node;
+    }
+    if (node->lhs) {
+        node->lhs = fold(cc, node->lhs);
+    }
+    if (node->rhs) {
+        node->rhs = fold(cc, node->rhs);
+    }
+    if (node->type == ND_ASSIGN || node->type == ND_RETURN) {
+        return node;
+    }
+
+    Node *lhs = node->lhs;
+    Node *rhs = node->rhs;
+    if (lhs->type == ND_NUM && rhs->type == ND_NUM) {
+        return new_num_node(cc, eval(cc, node->type, lhs->val, rhs->val), node->loc);
+    }
+
+    switch (node->type) {
+    case ND_ADD:
+        if (is_num(lhs, 0)) {
+            return rhs; // 0+x
+        }
+        if (is_num(rhs, 0)) {
+            return lhs; // x+0
+        }
+        if (lhs->type == ND_NUM) {
+            node->lhs = rhs; // c+x -> x+c
+            node->rhs = lhs;
+            return fold(cc, node);
+        }
+        if (rhs->type == ND_NUM && lhs->type == ND_ADD && lhs->rhs->type == ND_NUM) {
+            // (x+c1)+c2 -> x+(c1+c2)
+            lhs->rhs = new_num_node(cc, eval(cc, ND_ADD, lhs->rhs->val, rhs->val), rhs->loc);
+            return fold(cc, lhs);
+        }
+        break;
+    case ND_SUB:
+        if (is_num(rhs, 0)) {
+            return lhs; // x-0
+        }
+        if (is_num(lhs, 0) && rhs->type == ND_SUB && is_num(rhs->lhs, 0)) {
+            return rhs->rhs; // 0-(0-x)
+        }
+        if (rhs->type == ND_NUM) {
+            // x-c -> x+(-c)
+            node->type = ND_ADD;
+            node->rhs = new_num_node(cc, eval(cc, ND_SUB, 0, rhs->val), rhs->loc);
+            return fold(cc, node);
+        }
+        break;
+    case ND_MUL:
+        if (is_num(lhs, 1)) {
+            return rhs; // 1*x
+        }
+        if (is_num(rhs, 1)) {
+            return lhs; // x*1
+        }
+        if ((is_num(lhs, 0) && !has_side_effects(rhs)) || (is_num(rhs, 0) && !has_side_effects(lhs))) {
+            return new_num_node(cc, 0, node->loc); // x*0
+        }
+        break;
+    default:
+        break;
+    }
+    return node;
+}
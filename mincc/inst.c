@@ -0,0 +1,297 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mincc.h"
+#include "relax.h"
+
+// Operand formats
+typedef enum {
+    FMT_RR,    // op rd,rs
+    FMT_RS,    // op rs
+    FMT_RD,    // op rd
+    FMT_NONE,  // op
+    FMT_RI,    // op rd,n
+    FMT_IR,    // op n,rs
+    FMT_JUMP,  // op label,rs
+    FMT_CALL,  // op label
+    FMT_LABEL, // label:
+} InstFormat;
+
+// Effects
+#define R_RD    (1 << 0) // reads rd
+#define W_RD    (1 << 1) // writes rd
+#define R_RS    (1 << 2) // reads rs
+#define R_BP    (1 << 3) // reads r15 implicitly
+#define STACK   (1 << 4) // reads or changes SP or the stack
+#define BRANCH  (1 << 5) // control transfer or jump target
+
+typedef struct {
+    const char *name;
+    InstFormat format;
+    int effects;
+    int opcode;        // Encoding with all operand fields zero (Hardware.md)
+} InstInfo;
+
+static const InstInfo inst_info[] = {
+    [I_MOV]   = {"mov",  FMT_RR,    W_RD | R_RS,          0x0000},
+    [I_ADD]   = {"add",  FMT_RR,    R_RD | W_RD | R_RS,   0x0100},
+    [I_SUB]   = {"sub",  FMT_RR,    R_RD | W_RD | R_RS,   0x0200},
+    [I_LT]    = {"lt",   FMT_RR,    R_RD | W_RD | R_RS,   0x0300},
+    [I_MUL]   = {"mul",  FMT_RR,    R_RD | W_RD | R_RS,   0x0400},
+    [I_PUSH]  = {"push", FMT_RS,    R_RS | STACK,         0x0800},
+    [I_STS]   = {"sts",  FMT_RS,    R_RS | STACK,         0x0900},
+    [I_POP]   = {"pop",  FMT_RD,    W_RD | STACK,         0x0A00},
+    [I_LDS]   = {"lds",  FMT_RD,    W_RD | STACK,         0x0B00},
+    [I_RET]   = {"ret",  FMT_NONE,  STACK | BRANCH,       0x0C00},
+    [I_MVI]   = {"mvi",  FMT_RI,    W_RD,                 0x1000},
+    [I_STM]   = {"stm",  FMT_IR,    R_RS | R_BP,          0x2000},
+    [I_LDM]   = {"ldm",  FMT_RI,    W_RD | R_BP,          0x3000},
+    [I_JZ]    = {"jz",   FMT_JUMP,  R_RS | BRANCH,        0x4000},
+    [I_CALL]  = {"call", FMT_CALL,  STACK | BRANCH,       0x5000},
+    [I_JNZ]   = {"jnz",  FMT_JUMP,  R_RS | BRANCH,        0x6000},
+    [I_HALT]  = {"halt", FMT_NONE,  BRANCH,               0x7FFF},
+    [I_LABEL] = {NULL,   FMT_LABEL, BRANCH,               0},
+    [I_NOP]   = {NULL,   FMT_NONE,  0,                    0},
+};
+
+static Inst *new_inst(Compiler *cc, InstOp op) {
+    if (cc->inst_count == cc->inst_cap) {
+        long ncap = cc->inst_cap ? cc->inst_cap * 2 : 256;
+        Inst *ni = realloc(cc->insts, ncap * sizeof(Inst));
+        if (!ni) {
+            error_nomem(cc);
+        }
+        cc->insts = ni;
+        cc->inst_cap = ncap;
+    }
+    Inst *inst = &cc->insts[cc->inst_count++];
+    inst->op = op;
+    inst->rd = 0;
+    inst->rs = 0;
+    inst->imm = 0;
+    inst->label = NULL;
+    return inst;
+}
+
+// Append an instruction; unused operands are ignored
+void emit(Compiler *cc, InstOp op, int rd, int rs, long imm) {
+    Inst *inst = new_inst(cc, op);
+    inst->rd = rd;
+    inst->rs = rs;
+    inst->imm = imm;
+}
+
+void emit_label(Compiler *cc, const char *name) {
+    new_inst(cc, I_LABEL)->label = name;
+}
+
+// jz/jnz label,rs or call label (rs ignored)
+void emit_jump(Compiler *cc, InstOp op, const char *label, int rs) {
+    Inst *inst = new_inst(cc, op);
+    inst->label = label;
+    inst->rs = rs;
+}
+
+bool inst_reads(Inst *inst, int reg) {
+    int e = inst_info[inst->op].effects;
+    return ((e & R_RD) && inst->rd == reg) ||
+           ((e & R_RS) && inst->rs == reg) ||
+           ((e & R_BP) && reg == 15);
+}
+
+bool inst_writes(Inst *inst, int reg) {
+    return (inst_info[inst->op].effects & W_RD) && inst->rd == reg;
+}
+
+// Reads or changes SP or the stack
+bool inst_uses_stack(Inst *inst) {
+    return (inst_info[inst->op].effects & STACK) != 0;
+}
+
+// Control transfer or jump target: straight-line reasoning stops here
+bool inst_is_branch(Inst *inst) {
+    return (inst_info[inst->op].effects & BRANCH) != 0;
+}
+
+// An immediate is one byte: -255..255, negative values modulo 256
+static bool imm_fits(long imm) {
+    return imm > -256 && imm < 256;
+}
+
+// Print an immediate in the range mincasm accepts (-128..255): small
+// negative numbers stay readable, frame offsets below -128 become the
+// same byte in 0..255. A value that does not fit is printed unchanged
+// so that mincasm rejects it.
+static long imm8(long imm) {
+    return imm < -128 && imm_fits(imm) ? imm & 0xFF : imm;
+}
+
+// Append the instruction list to the output as assembly text
+void print_insts(Compiler *cc) {
+    for (long i = 0; i < cc->inst_count; i++) {
+        Inst *inst = &cc->insts[i];
+        const char *name = inst_info[inst->op].name;
+        switch (inst_info[inst->op].format) {
+        case FMT_RR:
+            out_printf(cc, "%s r%d,r%d\n", name, inst->rd, inst->rs);
+            break;
+        case FMT_RS:
+            out_printf(cc, "%s r%d\n", name, inst->rs);
+            break;
+        case FMT_RD:
+            out_printf(cc, "%s r%d\n", name, inst->rd);
+            break;
+        case FMT_NONE:
+            if (name) {
+                out_printf(cc, "%s\n", name);
+            }
+            break;
+        case FMT_RI:
+            out_printf(cc, "%s r%d,%ld\n", name, inst->rd, imm8(inst->imm));
+            break;
+        case FMT_IR:
+            out_printf(cc, "%s %ld,r%d\n", name, imm8(inst->imm), inst->rs);
+            break;
+        case FMT_JUMP:
+            out_printf(cc, "%s %s,r%d\n", name, inst->label, inst->rs);
+            break;
+        case FMT_CALL:
+            out_printf(cc, "%s %s\n", name, inst->label);
+            break;
+        case FMT_LABEL:
+            out_printf(cc, "%s:\n", inst->label);
+            break;
+        }
+    }
+}
+
+/***************************************************************
+Machine code (--emit=hex/bin)
+
+Labels are resolved in two steps over the instruction list: the
+first records the address of every label in an open-addressed table,
+the second encodes each instruction into one 15-bit word. Both count
+branches as one word; relax_branches / place_branches (common/relax.c,
+shared with mincasm) then add the page prefixes of far branches and
+patch the targets, so --emit=hex stays equal to mincc | mincasm.
+****************************************************************/
+
+typedef struct {
+    const char *name;
+    long addr;
+} LabelAddr;
+
+// FNV-1a
+static unsigned long hash_label(const char *name) {
+    unsigned long h = 2166136261u;
+    for (; *name; name++) {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    return h;
+}
+
+static LabelAddr *find_label_slot(LabelAddr *table, unsigned long mask, const char *name) {
+    unsigned long h = hash_label(name) & mask;
+    while (table[h].name && strcmp(table[h].name, name) != 0) {
+        h = (h + 1) & mask;
+    }
+    return &table[h];
+}
+
+static long label_addr(Compiler *cc, LabelAddr *table, unsigned long mask, const char *name) {
+    LabelAddr *slot = find_label_slot(table, mask, name);
+    if (!slot->name) {
+        error(cc, MINC_ERR_UNDEFINED, "Undefined label '%s'", name);
+    }
+    return slot->addr;
+}
+
+// Encode the instruction list into cc->code
+void encode_insts(Compiler *cc) {
+    long labels = 0, words = 0, branches = 0;
+    for (long i = 0; i < cc->inst_count; i++) {
+        InstOp op = cc->insts[i].op;
+        InstFormat format = inst_info[op].format;
+        labels += op == I_LABEL;
+        words += op != I_LABEL && op != I_NOP;
+        branches += format == FMT_JUMP || format == FMT_CALL;
+    }
+    unsigned long size = 16;
+    while (size < (unsigned long)labels * 2) {
+        size *= 2;
+    }
+    LabelAddr *table = arena_alloc(cc, size * sizeof(LabelAddr));
+    unsigned long mask = size - 1;
+
+    long addr = 0;
+    for (long i = 0; i < cc->inst_count; i++) {
+        Inst *inst = &cc->insts[i];
+        if (inst->op == I_LABEL) {
+            LabelAddr *slot = find_label_slot(table, mask, inst->label);
+            if (slot->name) {
+                error(cc, MINC_ERR_UNDEFINED, "Duplicate label '%s'", inst->label);
+            }
+            slot->name = inst->label;
+            slot->addr = addr;
+        } else if (inst->op != I_NOP) {
+            addr++;
+        }
+    }
+
+    // Near-form code; branch targets are patched in by place_branches
+    uint16_t *near = arena_alloc(cc, (words ? words : 1) * sizeof(uint16_t));
+    Branch *br = arena_alloc(cc, (branches ? branches : 1) * sizeof(Branch));
+    long n = 0, nbr = 0;
+    for (long i = 0; i < cc->inst_count; i++) {
+        Inst *inst = &cc->insts[i];
+        const InstInfo *info = &inst_info[inst->op];
+        int word = info->opcode;
+        switch (info->format) {
+        case FMT_RR:
+            word |= inst->rd << 4 | inst->rs;
+            break;
+        case FMT_RS:
+            word |= inst->rs;
+            break;
+        case FMT_RD:
+            word |= inst->rd << 4;
+            break;
+        case FMT_NONE:
+            if (!info->name) {
+                continue; // I_NOP
+            }
+            break;
+        case FMT_RI:
+        case FMT_IR:
+            if (!imm_fits(inst->imm)) {
+                error(cc, MINC_ERR_INTERNAL, "Immediate out of range: %ld", inst->imm);
+            }
+            word |= (inst->imm & 0xFF) << 4 | (info->format == FMT_RI ? inst->rd : inst->rs);
+            break;
+        case FMT_JUMP:
+        case FMT_CALL:
+            br[nbr].index = n;
+            br[nbr].target = label_addr(cc, table, mask, inst->label);
+            br[nbr].far = 0;
+            nbr++;
+            word |= info->format == FMT_JUMP ? inst->rs : 0;
+            break;
+        case FMT_LABEL:
+            continue;
+        }
+        near[n++] = (uint16_t)word;
+    }
+
+    long total = relax_branches(br, nbr, n);
+    if (total > MAX_PROGRAM_WORDS) {
+        error(cc, MINC_ERR_RANGE, "Program too large (%ld words, at most %d)", total, MAX_PROGRAM_WORDS);
+    }
+    cc->code = malloc((total ? total : 1) * sizeof(uint16_t));
+    if (!cc->code) {
+        error_nomem(cc);
+    }
+    place_branches(near, n, br, nbr, cc->code);
+    cc->code_count = total;
+}
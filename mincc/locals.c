@@ -0,0 +1,178 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mincc.h"
+
+/***************************************************************
+Local variable table
+
+Visible locals are kept in a chained hash table keyed on the
+(pointer, length) name. A new local is put at the head of its
+bucket, so it shadows outer locals of the same name. Leaving a
+scope removes its locals from the table and gives their frame
+slots back, so sibling scopes share slots. The frame size is the
+deepest slot ever used.
+
+Variables used without an "int" declaration are implicitly declared
+in the function's outermost scope, wherever the first use is. Such
+a slot is taken above every slot in use so far and is never handed
+back by the inner scopes that are open at that point.
+
+cc->local_vars still lists every local of the function (newest
+first) for the register allocator.
+****************************************************************/
+
+struct Scope {
+    struct Scope *up;
+    LocalVar *vars;  // Locals declared in this scope, newest first
+    long slots;      // Frame slots in use when the scope was entered
+};
+
+// FNV-1a
+static unsigned long hash_name(const char *name, unsigned long len) {
+    unsigned long h = 2166136261u;
+    for (unsigned long i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Double the table, keeping the order of each chain so shadowing still works
+static void grow_buckets(Compiler *cc) {
+    unsigned long new_count = cc->bucket_count ? cc->bucket_count * 2 : 64;
+    LocalVar **new_buckets = calloc(new_count, sizeof(LocalVar *));
+    LocalVar **tails = calloc(new_count, sizeof(LocalVar *));
+    if (!new_buckets || !tails) {
+        free(new_buckets);
+        free(tails);
+        error_nomem(cc);
+    }
+    for (unsigned long i = 0; i < cc->bucket_count; i++) {
+        LocalVar *var = cc->buckets[i];
+        while (var) {
+            LocalVar *shadow = var->shadow;
+            unsigned long b = var->hash & (new_count - 1);
+            var->shadow = NULL;
+            if (tails[b]) {
+                tails[b]->shadow = var;
+            } else {
+                new_buckets[b] = var;
+            }
+            tails[b] = var;
+            var = shadow;
+        }
+    }
+    free(tails);
+    free(cc->buckets);
+    cc->buckets = new_buckets;
+    cc->bucket_count = new_count;
+}
+
+void enter_scope(Compiler *cc) {
+    Scope *sc = arena_alloc(cc, sizeof(Scope));
+    sc->up = cc->scope;
+    sc->slots = cc->slots_in_use;
+    cc->scope = sc;
+}
+
+void leave_scope(Compiler *cc) {
+    for (LocalVar *var = cc->scope->vars; var; var = var->scope_next) {
+        LocalVar **p = &cc->buckets[var->hash & (cc->bucket_count - 1)];
+        while (*p != var) {
+            p = &(*p)->shadow;
+        }
+        *p = var->shadow;
+        cc->visible_count--;
+    }
+    cc->slots_in_use = cc->scope->slots;
+    cc->scope = cc->scope->up;
+}
+
+// Innermost visible local named like tok, or NULL
+LocalVar *find_local_var(Compiler *cc, Token *tok) {
+    if (!cc->bucket_count) {
+        return NULL;
+    }
+    unsigned long h = hash_name(tok->str, tok->size);
+    for (LocalVar *var = cc->buckets[h & (cc->bucket_count - 1)]; var; var = var->shadow) {
+        if (var->hash == h && var->name_len == tok->size && memcmp(var->name, tok->str, tok->size) == 0) {
+            return var;
+        }
+    }
+    return NULL;
+}
+
+static LocalVar *declare(Compiler *cc, Token *tok, Scope *sc, long offset) {
+    if (cc->visible_count >= cc->bucket_count) {
+        grow_buckets(cc);
+    }
+    LocalVar *var = arena_alloc(cc, sizeof(LocalVar));
+    var->name_len = tok->size;
+    var->name = tok->str; // view into user_input
+    var->hash = hash_name(tok->str, tok->size);
+    var->offset = offset;
+    var->reg = -1;
+    var->scope = sc;
+
+    LocalVar **bucket = &cc->buckets[var->hash & (cc->bucket_count - 1)];
+    var->shadow = *bucket;
+    *bucket = var;
+    cc->visible_count++;
+
+    var->scope_next = sc->vars;
+    sc->vars = var;
+    var->next = cc->local_vars;
+    cc->local_vars = var;
+    cc->local_var_count++;
+    return var;
+}
+
+// Declare a local in the current scope and give it the next frame slot
+LocalVar *add_local_var(Compiler *cc, Token *tok) {
+    LocalVar *var = find_local_var(cc, tok);
+    if (var && var->scope == cc->scope) {
+        error_at(cc, MINC_ERR_SYNTAX, tok->loc, "Redeclaration of '%.*s'", (int)tok->size, tok->str);
+    }
+    long offset = -(++cc->slots_in_use);
+    if (cc->slots_in_use > cc->max_slots) {
+        cc->max_slots = cc->slots_in_use;
+    }
+    return declare(cc, tok, cc->scope, offset);
+}
+
+// Declare a local on first use, in the function's outermost scope
+LocalVar *add_implicit_var(Compiler *cc, Token *tok) {
+    Scope *outer = cc->scope;
+    while (outer->up) {
+        outer = outer->up;
+    }
+    if (outer == cc->scope) {
+        return add_local_var(cc, tok);
+    }
+    // Reserve a slot no open scope will give back
+    long offset = -(++cc->max_slots);
+    for (Scope *sc = cc->scope; sc; sc = sc->up) {
+        sc->slots = cc->max_slots;
+    }
+    cc->slots_in_use = cc->max_slots;
+    return declare(cc, tok, outer, offset);
+}
+
+// Start an empty table for the next function
+void reset_locals(Compiler *cc) {
+    cc->local_vars = NULL;
+    cc->local_var_count = 0;
+    cc->slots_in_use = 0;
+    cc->max_slots = 0;
+}
+
+// Number of locals declared so far, in any scope
+long count_local_vars(Compiler *cc) {
+    return cc->local_var_count;
+}
+
+// Frame slots needed by the function
+long frame_size(Compiler *cc) {
+    return cc->max_slots;
+}
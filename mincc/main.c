@@ -1,18 +1,18 @@
-#include <ctype.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "mincc.h"
+#include "minc.h"
+#include "tool.h"
 
-Token *token;
+// mincc: command-line wrapper around minc_compile_opts()
 
-static char *user_input;
+static const char *input_name = "<stdin>";
 
-// Throw an error message and exit
-void error(const char *fmt, ...) {
+// Report a command-line or I/O error and exit
+static void fatal(const char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
     fprintf(stderr, "[Error]: ");
@@ -22,78 +22,131 @@ void error(const char *fmt, ...) {
     exit(EXIT_FAILURE);
 }
 
-void error_at(char *loc, const char *fmt, ...) {
-    va_list ap;
-    va_start(ap, fmt);
-
-    int pos = loc - user_input;
-    fprintf(stderr, "         %s\n", user_input);
-    fprintf(stderr, "[Error]: ");
-    fprintf(stderr, "%*s", pos, ""); // pos個の空白を出力
-    fprintf(stderr, "^ ");
-    vfprintf(stderr, fmt, ap);
-    fprintf(stderr, "\n");
-    va_end(ap);
-    exit(EXIT_FAILURE);
-}
-
-void warn(const char *fmt, ...) {
-    va_list ap;
-    va_start(ap, fmt);
-    fprintf(stderr, "[Warning]: ");
-    vfprintf(stderr, fmt, ap);
-    fprintf(stderr, "\n");
-    va_end(ap);
+// Read the whole stream into one null-terminated buffer, doubling its size as needed
+static char *read_input(FILE *fp, long *size) {
+    size_t cap = 4096, len = 0;
+    char *buf = malloc(cap);
+    if (!buf) {
+        fatal("out of memory");
+    }
+    size_t n;
+    while ((n = fread(buf + len, 1, cap - len - 1, fp)) > 0) {
+        len += n;
+        if (cap - len - 1 == 0) {
+            cap *= 2;
+            char *new_buf = realloc(buf, cap);
+            if (!new_buf) {
+                fatal("out of memory");
+            }
+            buf = new_buf;
+        }
+    }
+    if (ferror(fp)) {
+        fatal("cannot read %s", input_name);
+    }
+    buf[len] = '\0';
+    *size = (long)len;
+    return buf;
 }
 
-void warn_at(char *loc, const char *fmt, ...) {
-    va_list ap;
-    va_start(ap, fmt);
-
-    int pos = loc - user_input;
-    fprintf(stderr, "           %s\n", user_input);
-    fprintf(stderr, "[Warning]: ");
-    fprintf(stderr, "%*s", pos, ""); // pos個の空白を出力
-    fprintf(stderr, "^ ");
-    vfprintf(stderr, fmt, ap);
-    fprintf(stderr, "\n");
-    va_end(ap);
+// Load a file in one read, or stdin if path is NULL
+static char *load_input(const char *path, long *size) {
+    if (!path) {
+        return read_input(stdin, size);
+    }
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fatal("cannot open %s", path);
+    }
+    char *buf = NULL;
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        long len = ftell(fp);
+        if (len >= 0 && fseek(fp, 0, SEEK_SET) == 0) {
+            buf = malloc(len + 1);
+            if (!buf) {
+                fatal("out of memory");
+            }
+            *size = (long)fread(buf, 1, len, fp);
+            buf[*size] = '\0';
+        }
+    }
+    if (!buf) {
+        rewind(fp);
+        buf = read_input(fp, size); // not seekable
+    }
+    fclose(fp);
+    return buf;
 }
 
+typedef enum { EMIT_ASM, EMIT_HEX, EMIT_BIN } EmitKind;
 
+int main(int argc, char **argv) {
+    MincOptions opts = {0};
+    EmitKind emit = EMIT_ASM;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--emit=asm") == 0) {
+            emit = EMIT_ASM;
+        } else if (strcmp(argv[i], "--emit=hex") == 0) {
+            emit = EMIT_HEX;
+        } else if (strcmp(argv[i], "--emit=bin") == 0) {
+            emit = EMIT_BIN;
+        } else if (strcmp(argv[i], "-fregalloc") == 0) {
+            opts.regalloc = 1;
+        } else if (strcmp(argv[i], "-mno-mul") == 0) {
+            opts.no_mul = 1;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            opts.verbose = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            opts.stats = 1;
+        } else if (strncmp(argv[i], "-O", 2) == 0 && strlen(argv[i]) <= 3 &&
+                   (argv[i][2] == '\0' || ('0' <= argv[i][2] && argv[i][2] <= '2'))) {
+            opts.opt_level = argv[i][2] ? argv[i][2] - '0' : 1;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            fatal("Unknown option '%s'\nUsage: mincc [-O0|-O1|-O2] [-fregalloc] [-mno-mul] [--emit=asm|hex|bin] [--stats] [-v] [file]", argv[i]);
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            fatal("Only one input file is supported");
+        }
+    }
 
-int main() {
-    // if (argc != 2) {
-    //     fprintf(stderr, "Usage : <code>\n");
-    //     return EXIT_FAILURE;
-    // }
-    char line[256];
-    char *code = calloc(1, 1);
-    if (!code) {
-        error("out of memory");
+    if (path && strcmp(path, "-") == 0) {
+        path = NULL;
+    }
+    if (path) {
+        input_name = path;
     }
-    while (fgets(line, sizeof(line), stdin)) {
-        char *cr_lf = strpbrk(line, "\r\n"); //改行コードを排除
-        if (cr_lf) {
-            *cr_lf = '\0';
+    long size;
+    char *code = load_input(path, &size);
+    opts.input_name = input_name;
+    opts.diag = stderr;
+
+    if (emit == EMIT_ASM) {
+        char *asm_text;
+        int status = minc_compile_opts(code, (size_t)size, &opts, &asm_text);
+        free(code);
+        if (status != MINC_OK) {
+            return EXIT_FAILURE;
+        }
+        fputs(asm_text, stdout);
+        free(asm_text);
+    } else {
+        MincWords words;
+        int status = minc_compile_words(code, (size_t)size, &opts, &words);
+        free(code);
+        if (status != MINC_OK) {
+            return EXIT_FAILURE;
         }
-        char *new_code = (char *)realloc(code, strlen(code) + strlen(line) + 1);
-        if (!new_code) {
-            error("out of memory");
+        int ok = write_words(stdout, &words, emit == EMIT_HEX ? OUT_HEX : OUT_BIN);
+        free(words.data);
+        if (!ok) {
+            fatal("cannot write output");
         }
-        code = new_code;
-        strcat(code, line);
     }
-    fprintf(stderr, "Input code: %s\n", code);
-    user_input = code;
-
-    token = tokenize(user_input);
-
-    printf("call main\n");
-    printf("push r0\n");
-    printf("halt\n");
-    printf("main: ");
-    program();
 
+    if (opts.stats) {
+        report_peak_rss();
+    }
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -1,4 +1,9 @@
-char *mystrndup(const char *s, size_t n);
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "minc.h"
 
 typedef enum {
     TOKEN_EOF,
@@ -7,6 +12,33 @@ typedef enum {
     TOKEN_IDENT,
 } TokenType;
 
+// Keywords and punctuators
+typedef enum {
+    TK_NONE,      // Not a keyword or punctuator
+    TK_PLUS,      // +
+    TK_MINUS,     // -
+    TK_STAR,      // *
+    TK_LPAREN,    // (
+    TK_RPAREN,    // )
+    TK_LT,        // <
+    TK_GT,        // >
+    TK_ASSIGN,    // =
+    TK_SEMICOLON, // ;
+    TK_EQ,        // ==
+    TK_NE,        // !=
+    TK_LE,        // <=
+    TK_GE,        // >=
+    TK_LBRACE,    // {
+    TK_RBRACE,    // }
+    TK_COMMA,     // ,
+    TK_RETURN,    // return
+    TK_IF,        // if
+    TK_ELSE,      // else
+    TK_WHILE,     // while
+    TK_FOR,       // for
+    TK_INT,       // int
+} TokenKind;
+
 typedef enum {
     ND_ADD,
     ND_SUB,
@@ -21,83 +53,271 @@ typedef enum {
     ND_LOC_VAR,
     ND_ASSIGN,
     ND_RETURN,
-
-    ND_EOF
+    ND_BLOCK,
+    ND_IF,
+    ND_WHILE,
+    ND_FOR,
+    ND_CALL,
 } NodeType;
 
 typedef struct Token {
     TokenType type;
+    TokenKind kind;  // Keyword or punctuator kind (TOKEN_RESERVED only)
     struct Token *next;
     long value;
     unsigned long size; // Token size
-    char *str;       // Token string (must be null-terminated)
+    char *str;       // Token text in user_input (not null-terminated, size bytes)
     char *loc;
 } Token;
 
+// Instructions (see Hardware.md), plus pseudo instructions
+typedef enum {
+    I_MOV,
+    I_ADD,
+    I_SUB,
+    I_LT,
+    I_MUL,
+    I_PUSH,
+    I_STS,
+    I_POP,
+    I_LDS,
+    I_RET,
+    I_MVI,
+    I_STM,
+    I_LDM,
+    I_JZ,
+    I_CALL,
+    I_JNZ,
+    I_HALT,
+    I_LABEL, // "name:"
+    I_NOP,   // deleted by the peephole optimizer, never printed
+} InstOp;
+
+typedef struct Inst {
+    InstOp op;
+    int rd;
+    int rs;
+    long imm;
+    const char *label; // Jump target (jz/jnz/call) or label name (I_LABEL)
+} Inst;
+
+struct LocalVar;
+struct Function;
+
 typedef struct Node {
     NodeType type;     // Node type
     struct Node *lhs;  // Left-hand side
     struct Node *rhs;  // Right-hand side
+    struct Node *body; // Statements (ND_BLOCK) or loop body (ND_WHILE, ND_FOR)
+    struct Node *next; // Next statement in a block
+    struct Node *cond; // Condition (ND_IF, ND_WHILE, ND_FOR; NULL in for(;;))
+    struct Node *then; // ND_IF
+    struct Node *els;  // ND_IF, or NULL
+    struct Node *init; // ND_FOR, or NULL
+    struct Node *inc;  // ND_FOR, or NULL
+    struct Node *args; // Arguments linked by next (ND_CALL)
+    struct Function *func; // Callee (ND_CALL)
     long val;          // Value (only for ND_NUM)
     long offset;       // Offset from BP (only for ND_LOC_VAR)
     unsigned long name_len; // Length of identifier name
-    char *name;    // Identifier name (only for ND_LOC_VAR)
+    char *name;    // Identifier name in user_input (only for ND_LOC_VAR, not null-terminated)
+    struct LocalVar *var; // Variable (only for ND_LOC_VAR)
     char *loc;
 } Node;
 
 typedef struct LocalVar {
-    struct LocalVar *next;
+    struct LocalVar *next;       // All locals of the function, newest first
+    struct LocalVar *shadow;     // Next local in the same hash bucket
+    struct LocalVar *scope_next; // Next local declared in the same scope
+    struct Scope *scope;         // Scope the local was declared in
+    unsigned long hash;          // Hash of the name
     unsigned long name_len; // Length of variable name
-    char *name;       // Variable name (null-terminated)
+    char *name;       // Variable name in user_input (not null-terminated)
     long offset;      // Offset from BP
+    long uses;        // Number of references
+    int reg;          // Register holding the variable, or -1 if in memory
 } LocalVar;
 
-extern Token *token;
+typedef struct Scope Scope;
+struct ArenaBlock;
 
-// Tokenizer functions
-// Create a new token and link it to the current token
-Token *new_token(TokenType type, Token *current, const char *str, unsigned long size, long val, char *loc);
+/***************************************************************
+Calling convention
+
+r0       : return value
+r1..r4   : arguments (at most MAX_PARAMS)
+r0..r7   : caller-saved; expression temporaries live here
+r8..r14  : callee-saved; register locals live here first
+r15      : base pointer, callee-saved
+
+The return address is the only thing a call puts on the stack.
+A function saves the callee-saved registers it uses before setting
+up its frame; one without frame slots sets up no frame at all.
+main is only called by the startup code, which keeps nothing in
+registers, so it saves nothing.
+****************************************************************/
+
+#define MAX_PARAMS 4
+#define FIRST_CALLEE_SAVED 8
+
+// Data RAM of the core (stack and data). A frame has to fit in it next
+// to the return address (up to 2 bytes), the saved BP and registers.
+#define RAM_BYTES 256
+#define FRAME_OVERHEAD 3
+
+// Runtime multiply for -mno-mul: r0 = r1 * r2, clobbers r1..r5 only
+// (leaf functions keep register locals in r6/r7 across it)
+#define MUL_ROUTINE "__mul"
+#define MUL_ROUTINE_LAST_CLOBBERED 5
+
+typedef struct Function {
+    struct Function *next;
+    char *name;             // Null-terminated, also the label
+    unsigned long name_len;
+    int param_count;
+    LocalVar *params[MAX_PARAMS];
+    Node *body;             // ND_BLOCK, or NULL if only declared
+    bool has_calls;         // Not a leaf function
+    bool called;
+    char *loc;
+
+    // Locals, filled in when the body has been parsed
+    LocalVar *locals;       // All locals, newest first
+    long local_count;
+    long frame_slots;
+
+    // Code generation
+    bool has_frame;         // BP is set up
+    unsigned saved_regs;    // Callee-saved registers pushed in the prologue
+} Function;
+
+// State of one compilation (see compile.c). Every compiler function
+// takes it as its first argument; there are no globals.
+typedef struct Compiler {
+    // Code generation options
+    bool opt_regalloc;
+    int opt_level;
+    bool opt_verbose;
+    bool opt_no_mul;         // No mul instruction (-mno-mul)
+    bool opt_stats;          // Report frame sizes and phase times (--stats)
+    clock_t phase_start;     // Start of the current phase (--stats)
+    FILE *diag;              // Diagnostics, or NULL
 
+    // Input
+    char *user_input;        // Null-terminated copy of the source
+    const char *input_name;
+    long *line_starts;       // Offsets of the first character of every line
+    long line_count;
+    Token *token;            // Current token
+
+    struct ArenaBlock *arena;
+
+    // Local variable table (locals.c)
+    LocalVar *local_vars;
+    LocalVar **buckets;
+    unsigned long bucket_count;
+    unsigned long visible_count;
+    long local_var_count;
+    Scope *scope;
+    long slots_in_use;
+    long max_slots;
+
+    // Emitted instruction list
+    Inst *insts;
+    long inst_count;
+    long inst_cap;
+
+    // Parser state
+    Function *funcs;         // In definition order
+    Function *cur_func;      // Function being parsed or generated
+    int loop_depth;          // Loops around the current token
+    long label_count;        // Generated labels so far
+
+    bool uses_mul_routine;   // Some multiplication calls MUL_ROUTINE
+
+    // Register allocator (regalloc.c)
+    int temp_regs;           // r0..r(temp_regs-1) are temporaries
+    unsigned free_regs;      // bitmask of free temporaries
+
+    // Assembly text
+    char *out;
+    size_t out_len;
+    size_t out_cap;
+
+    // Machine code (encode_insts)
+    uint16_t *code;
+    size_t code_count;
+
+    jmp_buf bail;            // error() jumps back to minc_compile_opts()
+    MincStatus status;
+} Compiler;
+
+// Compilation-scoped arena
+void *arena_alloc(Compiler *cc, size_t size);
+void arena_release(Compiler *cc);
+
+// Tokenizer functions
 // Tokenize the input string and return the head of the token list
-Token *tokenize(const char *p);
+Token *tokenize(Compiler *cc, const char *p);
 
 // Token consumption functions
-bool consume(const char *op, char *loc);
-void expect(const char *op, char *loc);
-long expect_number(char *loc);
-char *expect_ident(char *loc);
-bool is_number_node();
-bool at_eof();
+bool consume(Compiler *cc, TokenKind kind, char *loc);
+void expect(Compiler *cc, TokenKind kind, char *loc);
+long expect_number(Compiler *cc, char *loc);
+char *expect_ident(Compiler *cc, char *loc);
+bool is_number_node(Compiler *cc);
+bool at_eof(Compiler *cc);
 
 // Genelate node
-Node *new_node(NodeType type, Node *lhs, Node *rhs, char *loc);
-Node *new_num_node(long val, char *loc);
-Node *new_ident_node(char *name, long offset, char *loc);
-
-// Syntax tree parsing functions
-void program();
-Node *stmt(char *l);
-Node *assign(char *l);
-Node *equality(char *l);
-Node *relational(char *l);
-Node *expr(char *l);
-Node *add(char *l);
-Node *mul(char *l);
-Node *primary(char *l);
-Node *unary(char *l);
+Node *new_num_node(Compiler *cc, long val, char *loc);
+
+// Syntax tree parsing
+Function *program(Compiler *cc);
 
 // Local variable functions
-LocalVar *find_local_var(Token *tok);
-void add_local_var(Token *tok);
-long count_local_vars();
+void enter_scope(Compiler *cc);
+void leave_scope(Compiler *cc);
+LocalVar *find_local_var(Compiler *cc, Token *tok);
+LocalVar *add_local_var(Compiler *cc, Token *tok);
+LocalVar *add_implicit_var(Compiler *cc, Token *tok);
+void reset_locals(Compiler *cc);
+long count_local_vars(Compiler *cc);
+long frame_size(Compiler *cc);
+
+// Constant folding (-O1 and above)
+Node *fold(Compiler *cc, Node *node);
 
 // node genelator function
-void generate(Node *node);
-void generate_prologue(long local_var_count);
+void generate_program(Compiler *cc, Function *funcs);
+void generate_epilogue(Compiler *cc);
+int mul_digits(long c, int *digits);
+
+// Instruction list functions
+void emit(Compiler *cc, InstOp op, int rd, int rs, long imm);
+void emit_label(Compiler *cc, const char *name);
+void emit_jump(Compiler *cc, InstOp op, const char *label, int rs);
+bool inst_reads(Inst *inst, int reg);
+bool inst_writes(Inst *inst, int reg);
+bool inst_uses_stack(Inst *inst);
+bool inst_is_branch(Inst *inst);
+void print_insts(Compiler *cc);
+void encode_insts(Compiler *cc);
+
+// Peephole optimizer (-O1 and above)
+void peephole(Compiler *cc);
+
+// Register-allocating code generator (-fregalloc)
+long assign_local_regs(Compiler *cc, Function *fn);
+void generate_reg(Compiler *cc, Node *node);
+void generate_branch_reg(Compiler *cc, Node *cond, const char *label, bool if_true);
+
+// Output and error handling functions (compile.c)
+void out_printf(Compiler *cc, const char *fmt, ...);
 
-// Error handling functions
-void error(const char *fmt, ...);
-void error_at(char *loc, const char *fmt, ...);
+// Report an error and abandon the compilation
+void error(Compiler *cc, MincStatus status, const char *fmt, ...);
+void error_at(Compiler *cc, MincStatus status, char *loc, const char *fmt, ...);
+void error_nomem(Compiler *cc);
 
-void warn(const char *fmt, ...);
-void warn_at(char *loc, const char *fmt, ...);
+void warn(Compiler *cc, const char *fmt, ...);
+void warn_at(Compiler *cc, char *loc, const char *fmt, ...);
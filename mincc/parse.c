@@ -7,79 +7,92 @@
 
 #include "mincc.h"
 
-// なかったから是非もないよネ！
-// strndup, but raise error() on failure
-char *mystrndup(const char *s, size_t n) {
-    char* new = malloc(n+1);
-    if (new) {
-        strncpy(new, s, n);
-        new[n] = '\0';
-    } else {
-        error("Memory allocation failed");
-    }
-    return new;
-}
+// Spelling of each keyword and punctuator (for diagnostics)
+static const char *token_kind_str[] = {
+    [TK_NONE] = "",
+    [TK_PLUS] = "+",
+    [TK_MINUS] = "-",
+    [TK_STAR] = "*",
+    [TK_LPAREN] = "(",
+    [TK_RPAREN] = ")",
+    [TK_LT] = "<",
+    [TK_GT] = ">",
+    [TK_ASSIGN] = "=",
+    [TK_SEMICOLON] = ";",
+    [TK_EQ] = "==",
+    [TK_NE] = "!=",
+    [TK_LE] = "<=",
+    [TK_GE] = ">=",
+    [TK_LBRACE] = "{",
+    [TK_RBRACE] = "}",
+    [TK_COMMA] = ",",
+    [TK_RETURN] = "return",
+    [TK_IF] = "if",
+    [TK_ELSE] = "else",
+    [TK_WHILE] = "while",
+    [TK_FOR] = "for",
+    [TK_INT] = "int",
+};
 
-// Consume a token if it matches the expected string
+// Consume a token if it is of the expected kind
 // Return true if matched, false otherwise
-bool consume(const char *op, char *loc) {
-    if (token->type != TOKEN_RESERVED || strcmp(token->str, op) != 0) {
+bool consume(Compiler *cc, TokenKind kind, char *loc) {
+    if (cc->token->kind != kind) {
         return false;
     }
-    loc = token->loc;
-    token = token->next;
+    loc = cc->token->loc;
+    cc->token = cc->token->next;
     return true;
 }
 
-// Consume a token if it matches the expected string
+// Consume a token if it is of the expected kind
 // Otherwise, throw an error
-void expect(const char *op, char *loc) {
-    if (token->type != TOKEN_RESERVED || strcmp(token->str, op) != 0) {
-        error_at(token->loc, "Expected '%s', but got '%s'", op, token->str);
+void expect(Compiler *cc, TokenKind kind, char *loc) {
+    if (cc->token->kind != kind) {
+        error_at(cc, MINC_ERR_SYNTAX, cc->token->loc, "Expected '%s', but got '%.*s'", token_kind_str[kind], (int)cc->token->size, cc->token->str);
     }
-    loc = token->loc;
-    token = token->next;
+    loc = cc->token->loc;
+    cc->token = cc->token->next;
 }
 
 // Expect a number token and return its value
 // Otherwise, throw an error
-long expect_number(char *loc) {
-    if (token->type != TOKEN_NUMBER) {
-        error_at(token->loc, "Expected a number, but got '%s'", token->str);
+long expect_number(Compiler *cc, char *loc) {
+    if (cc->token->type != TOKEN_NUMBER) {
+        error_at(cc, MINC_ERR_SYNTAX, cc->token->loc, "Expected a number, but got '%.*s'", (int)cc->token->size, cc->token->str);
     }
-    loc = token->loc;
-    long val = token->value;
-    token = token->next;
+    loc = cc->token->loc;
+    long val = cc->token->value;
+    cc->token = cc->token->next;
     return val;
 }
 
 // Expect an identifier token and return its string
 // Otherwise, throw an error
-char *expect_ident(char *loc) {
-    if (token->type != TOKEN_IDENT) {
-        error_at(token->loc, "Expected an identifier, but got '%s'", token->str);
+char *expect_ident(Compiler *cc, char *loc) {
+    if (cc->token->type != TOKEN_IDENT) {
+        error_at(cc, MINC_ERR_SYNTAX, cc->token->loc, "Expected an identifier, but got '%.*s'", (int)cc->token->size, cc->token->str);
     }
-    char *name = token->str;
-    loc = token->loc;
-    token = token->next;
+    char *name = cc->token->str;
+    loc = cc->token->loc;
+    cc->token = cc->token->next;
     return name;
 }
 
-bool is_number_node() {
-    return token->type == TOKEN_NUMBER;
+bool is_number_node(Compiler *cc) {
+    return cc->token->type == TOKEN_NUMBER;
 }
 
 // Check if the current token is EOF
-bool at_eof() {
-    return token->type == TOKEN_EOF;
+bool at_eof(Compiler *cc) {
+    return cc->token->type == TOKEN_EOF;
 }
 
-Token *new_token(TokenType type, Token *current, const char *str, unsigned long size, long val, char *loc) {
-    Token *tok = calloc(1, sizeof(Token));
+static Token *new_token(Compiler *cc, TokenType type, TokenKind kind, Token *current, const char *str, unsigned long size, long val, char *loc) {
+    Token *tok = arena_alloc(cc, sizeof(Token));
     tok->type = type;
-    if (str) {
-        tok->str = mystrndup(str, size);
-    }
+    tok->kind = kind;
+    tok->str = (char *)str; // view into user_input, not null-terminated
     tok->size = size;
     tok->value = val;
     tok->loc = loc;
@@ -87,38 +100,38 @@ Token *new_token(TokenType type, Token *current, const char *str, unsigned long
     return tok;
 }
 
-void print_token_list(Token *head) {
+static void print_token_list(Compiler *cc, Token *head) {
     Token *cur = head;
     while (cur) {
         switch (cur->type) {
             case TOKEN_EOF:
-                fprintf(stderr, "TOKEN_EOF\n");
+                fprintf(cc->diag, "TOKEN_EOF\n");
                 break;
             case TOKEN_NUMBER:
-                fprintf(stderr, "TOKEN_NUMBER: %ld\n", cur->value);
+                fprintf(cc->diag, "TOKEN_NUMBER: %ld\n", cur->value);
                 break;
             case TOKEN_RESERVED:
-                fprintf(stderr, "TOKEN_RESERVED: %s\n", cur->str);
+                fprintf(cc->diag, "TOKEN_RESERVED: %.*s\n", (int)cur->size, cur->str);
                 break;
             case TOKEN_IDENT:
-                fprintf(stderr, "TOKEN_IDENT: %s\n", cur->str);
+                fprintf(cc->diag, "TOKEN_IDENT: %.*s\n", (int)cur->size, cur->str);
                 break;
             default:
-                fprintf(stderr, "Unknown token type\n");
+                fprintf(cc->diag, "Unknown token type\n");
                 break;
         }
         cur = cur->next;
     }
 }
 
-bool isalphanumub(char c) {
+static bool isalphanumub(char c) {
     return  ('a' <= c && c <= 'z') ||
             ('A' <= c && c <= 'Z') ||
             ('0' <= c && c <= '9') ||
             (c == '_');
 }
 
-bool isalphaub(char c) {
+static bool isalphaub(char c) {
     return  ('a' <= c && c <= 'z') ||
             ('A' <= c && c <= 'Z') ||
             (c == '_');
@@ -127,7 +140,7 @@ bool isalphaub(char c) {
 /*****************************************************************
 ident_name = [a-zA-Z_][a-zA-Z0-9_]*
 ******************************************************************/
-unsigned long read_ident_size(const char *p) {
+static unsigned long read_ident_size(const char *p) {
     const char *start = p;
     if (!isalphaub(*p)) {
         return 0;
@@ -139,7 +152,74 @@ unsigned long read_ident_size(const char *p) {
     return p - start;
 }
 
-Token *tokenize(const char *p){
+// Keyword kind of an identifier, or TK_NONE
+static TokenKind keyword_kind(const char *p, unsigned long size) {
+    switch (size) {
+    case 2:
+        if (memcmp(p, "if", 2) == 0) {
+            return TK_IF;
+        }
+        break;
+    case 3:
+        if (memcmp(p, "for", 3) == 0) {
+            return TK_FOR;
+        }
+        if (memcmp(p, "int", 3) == 0) {
+            return TK_INT;
+        }
+        break;
+    case 4:
+        if (memcmp(p, "else", 4) == 0) {
+            return TK_ELSE;
+        }
+        break;
+    case 5:
+        if (memcmp(p, "while", 5) == 0) {
+            return TK_WHILE;
+        }
+        break;
+    case 6:
+        if (memcmp(p, "return", 6) == 0) {
+            return TK_RETURN;
+        }
+        break;
+    }
+    return TK_NONE;
+}
+
+// Punctuator kind at p and its length, or TK_NONE
+static TokenKind punct_kind(const char *p, unsigned long *size) {
+    *size = 2;
+    switch (p[0]) {
+    case '=':
+        if (p[1] == '=') return TK_EQ;
+        *size = 1;
+        return TK_ASSIGN;
+    case '!':
+        if (p[1] == '=') return TK_NE;
+        break;
+    case '<':
+        if (p[1] == '=') return TK_LE;
+        *size = 1;
+        return TK_LT;
+    case '>':
+        if (p[1] == '=') return TK_GE;
+        *size = 1;
+        return TK_GT;
+    case '+': *size = 1; return TK_PLUS;
+    case '-': *size = 1; return TK_MINUS;
+    case '*': *size = 1; return TK_STAR;
+    case '(': *size = 1; return TK_LPAREN;
+    case ')': *size = 1; return TK_RPAREN;
+    case ';': *size = 1; return TK_SEMICOLON;
+    case '{': *size = 1; return TK_LBRACE;
+    case '}': *size = 1; return TK_RBRACE;
+    case ',': *size = 1; return TK_COMMA;
+    }
+    return TK_NONE;
+}
+
+Token *tokenize(Compiler *cc, const char *p){
     Token head;
     head.next = NULL;
     Token *cur = &head;
@@ -151,28 +231,19 @@ Token *tokenize(const char *p){
             continue;
         }
 
-        if (strncmp(p, "return", 6) == 0 && !isalphanumub(p[6])) {
-            cur = new_token(TOKEN_RESERVED, cur, p, 6, 0, (char *)p);
-            p += 6;
+        unsigned long size;
+        TokenKind kind = punct_kind(p, &size);
+        if (kind != TK_NONE) {
+            cur = new_token(cc, TOKEN_RESERVED, kind, cur, p, size, 0, (char *)p);
+            p += size;
             continue;
         }
 
-        if (strncmp(p, "==", 2) == 0 || strncmp(p, "!=", 2) == 0 || strncmp(p, "<=", 2) == 0 || strncmp(p, ">=", 2) == 0) {
-            cur = new_token(TOKEN_RESERVED, cur, p, 2, 0, (char *)p);
-            p += 2;
-            continue;
-        }
-
-        if (*p == '+' || *p == '-' || *p == '*' || *p == '(' || *p == ')' || *p == '<' || *p == '>' || *p == '=' || *p == ';') {
-            cur = new_token(TOKEN_RESERVED, cur, p, 1, 0, (char *)p);
-            p++;
-            continue;
-        }
-
-        unsigned long ident_size = read_ident_size(p);
-        if (ident_size > 0) {
-            cur = new_token(TOKEN_IDENT, cur, p, ident_size, 0, (char *)p);
-            p += ident_size;
+        size = read_ident_size(p);
+        if (size > 0) {
+            kind = keyword_kind(p, size);
+            cur = new_token(cc, kind == TK_NONE ? TOKEN_IDENT : TOKEN_RESERVED, kind, cur, p, size, 0, (char *)p);
+            p += size;
             continue;
         }
 
@@ -180,17 +251,19 @@ Token *tokenize(const char *p){
             char *q = (char *)p;
             long val = strtol(p, &q, 0);
             if (val < 0 || val > 0xFF) {
-                error_at((char *)p, "Number out of range");
+                error_at(cc, MINC_ERR_RANGE, (char *)p, "Number out of range");
             }
-            cur = new_token(TOKEN_NUMBER, cur, NULL, 0, val, (char *)p);
+            cur = new_token(cc, TOKEN_NUMBER, TK_NONE, cur, p, q - p, val, (char *)p);
             p = q;
             continue;
         }
 
-        error_at((char *)p, "Invalid token");
+        error_at(cc, MINC_ERR_SYNTAX, (char *)p, "Invalid token");
     }
 
-    new_token(TOKEN_EOF, cur, NULL, 0, 0, (char *)p);
-    print_token_list(head.next);
+    new_token(cc, TOKEN_EOF, TK_NONE, cur, p, 0, 0, (char *)p);
+    if (cc->opt_verbose && cc->diag) {
+        print_token_list(cc, head.next);
+    }
     return head.next;
 }
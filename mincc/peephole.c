@@ -0,0 +1,206 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mincc.h"
+
+/***************************************************************
+Peephole optimizer
+
+Rules are tried in table order at every instruction until none of
+them fires anywhere. Deleted instructions become I_NOP and are
+compacted away at the end. Scans never cross a label or branch and
+look at most WINDOW instructions ahead.
+****************************************************************/
+
+#define WINDOW 16
+
+// Index of the next instruction after i that is not deleted, or -1
+static long next_inst(Compiler *cc, long i) {
+    for (i++; i < cc->inst_count; i++) {
+        if (cc->insts[i].op != I_NOP) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// True if reg is overwritten before it is read after instruction i
+static bool reg_dead_after(Compiler *cc, long i, int reg) {
+    int seen = 0;
+    for (long j = next_inst(cc, i); j >= 0 && seen < WINDOW; j = next_inst(cc, j), seen++) {
+        Inst *inst = &cc->insts[j];
+        if (inst->op == I_CALL) {
+            // Reads the argument registers, clobbers the other caller-saved
+            // ones; MUL_ROUTINE preserves the registers above r5
+            int last = strcmp(inst->label, MUL_ROUTINE) == 0 ? MUL_ROUTINE_LAST_CLOBBERED : FIRST_CALLEE_SAVED - 1;
+            return reg == 0 || (reg > MAX_PARAMS && reg <= last);
+        }
+        if (inst_reads(inst, reg) || inst_is_branch(inst)) {
+            return false;
+        }
+        if (inst_writes(inst, reg)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// push rX; ...; pop rY  ->  ...; mov rY,rX
+// when nothing in between touches the stack or writes rX
+static bool push_pop_forward(Compiler *cc, long i) {
+    Inst *push = &cc->insts[i];
+    if (push->op != I_PUSH) {
+        return false;
+    }
+    int seen = 0;
+    for (long j = next_inst(cc, i); j >= 0 && seen < WINDOW; j = next_inst(cc, j), seen++) {
+        Inst *inst = &cc->insts[j];
+        if (inst->op == I_POP) {
+            if (inst->rd == push->rs) {
+                inst->op = I_NOP;
+            } else {
+                inst->op = I_MOV;
+                inst->rs = push->rs;
+            }
+            push->op = I_NOP;
+            return true;
+        }
+        if (inst_is_branch(inst) || inst_uses_stack(inst) || inst_writes(inst, push->rs)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// mov rX,rX  ->  (nothing)
+static bool self_move(Compiler *cc, long i) {
+    Inst *inst = &cc->insts[i];
+    if (inst->op != I_MOV || inst->rd != inst->rs) {
+        return false;
+    }
+    inst->op = I_NOP;
+    return true;
+}
+
+// mov rA,rB; mov rB,rA  ->  mov rA,rB
+static bool move_back(Compiler *cc, long i) {
+    Inst *a = &cc->insts[i];
+    long j = next_inst(cc, i);
+    if (a->op != I_MOV || j < 0) {
+        return false;
+    }
+    Inst *b = &cc->insts[j];
+    if (b->op != I_MOV || b->rd != a->rs || b->rs != a->rd) {
+        return false;
+    }
+    b->op = I_NOP;
+    return true;
+}
+
+// mvi rT,0; add rT,rS  ->  mov rT,rS
+// mvi rT,0; add rD,rT  ->  (nothing) when rT is dead afterwards
+static bool add_zero(Compiler *cc, long i) {
+    Inst *mvi = &cc->insts[i];
+    long j = next_inst(cc, i);
+    if (mvi->op != I_MVI || (mvi->imm & 0xFF) != 0 || j < 0) {
+        return false;
+    }
+    Inst *add = &cc->insts[j];
+    if (add->op != I_ADD) {
+        return false;
+    }
+    if (add->rd == mvi->rd && add->rs != mvi->rd) {
+        mvi->op = I_NOP;
+        add->op = I_MOV;
+        return true;
+    }
+    if (add->rs == mvi->rd && add->rd != mvi->rd && reg_dead_after(cc, j, mvi->rd)) {
+        mvi->op = I_NOP;
+        add->op = I_NOP;
+        return true;
+    }
+    return false;
+}
+
+// mvi/ldm/mov rT,...; mov rV,rT  ->  mvi/ldm/mov rV,...
+// when rT is dead afterwards
+static bool copy_forward(Compiler *cc, long i) {
+    Inst *def = &cc->insts[i];
+    long j = next_inst(cc, i);
+    if ((def->op != I_MVI && def->op != I_LDM && def->op != I_MOV) || j < 0) {
+        return false;
+    }
+    Inst *mov = &cc->insts[j];
+    if (mov->op != I_MOV || mov->rs != def->rd || mov->rd == def->rd || !reg_dead_after(cc, j, def->rd)) {
+        return false;
+    }
+    def->rd = mov->rd;
+    mov->op = I_NOP;
+    return true;
+}
+
+// A register write (mvi, mov, ldm, lds, arithmetic) that is never read
+static bool dead_write(Compiler *cc, long i) {
+    Inst *inst = &cc->insts[i];
+    switch (inst->op) {
+    case I_MOV:
+    case I_ADD:
+    case I_SUB:
+    case I_LT:
+    case I_MUL:
+    case I_MVI:
+    case I_LDM:
+    case I_LDS:
+        break;
+    default:
+        return false;
+    }
+    if (!reg_dead_after(cc, i, inst->rd)) {
+        return false;
+    }
+    inst->op = I_NOP;
+    return true;
+}
+
+typedef bool (*PeepholeRule)(Compiler *cc, long i);
+
+static const struct {
+    const char *name;
+    int level;         // minimum -O level
+    PeepholeRule apply;
+} rules[] = {
+    {"push/pop forwarding", 1, push_pop_forward},
+    {"self move",           1, self_move},
+    {"move back",           1, move_back},
+    {"add zero",            1, add_zero},
+    {"copy forwarding",     1, copy_forward},
+    {"dead write",          1, dead_write},
+};
+
+void peephole(Compiler *cc) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (long i = 0; i < cc->inst_count; i++) {
+            if (cc->insts[i].op == I_NOP) {
+                continue;
+            }
+            for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+                if (cc->opt_level >= rules[r].level && rules[r].apply(cc, i)) {
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    long n = 0;
+    for (long i = 0; i < cc->inst_count; i++) {
+        if (cc->insts[i].op != I_NOP) {
+            cc->insts[n++] = cc->insts[i];
+        }
+    }
+    cc->inst_count = n;
+}
@@ -0,0 +1,482 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mincc.h"
+
+/***************************************************************
+Register-allocating code generator (-fregalloc)
+
+r15      : base pointer
+r14..r8  : local variables, most referenced first
+r7..r6   : more local variables in leaf functions
+r0..     : expression temporaries, at least MIN_TEMP_REGS
+
+Expressions are evaluated in temporaries in Sethi-Ullman order
+(the operand needing more registers first) and only spill to the
+stack when the temporaries run out. Temporaries are caller-saved
+(see the calling convention in mincc.h): a call pushes the live
+ones and pops them afterwards.
+****************************************************************/
+
+#define MIN_TEMP_REGS 6
+#define MAX_REG_LOCALS (15 - MIN_TEMP_REGS)
+
+static int alloc_reg(Compiler *cc) {
+    for (int r = 0; r < cc->temp_regs; r++) {
+        if (cc->free_regs & (1u << r)) {
+            cc->free_regs &= ~(1u << r);
+            return r;
+        }
+    }
+    error(cc, MINC_ERR_RANGE, "Out of temporary registers");
+    return -1;
+}
+
+static void free_reg(Compiler *cc, int r) {
+    if (r < cc->temp_regs) {
+        cc->free_regs |= 1u << r;
+    }
+}
+
+static int count_free_regs(Compiler *cc) {
+    int n = 0;
+    for (int r = 0; r < cc->temp_regs; r++) {
+        if (cc->free_regs & (1u << r)) {
+            n++;
+        }
+    }
+    return n;
+}
+
+static int compare_uses(const void *a, const void *b) {
+    const LocalVar *x = *(LocalVar *const *)a;
+    const LocalVar *y = *(LocalVar *const *)b;
+    if (x->uses != y->uses) {
+        return x->uses < y->uses ? 1 : -1;
+    }
+    if (x->offset != y->offset) {
+        return x->offset < y->offset ? 1 : -1; // declaration order
+    }
+    return 0;
+}
+
+// Registers for the locals of fn, best first. Callee-saved registers
+// cost a push/pop pair (except in main), caller-saved ones would have
+// to be saved around every call, so only leaf functions use those.
+static int local_regs(Function *fn, int *regs) {
+    bool is_main = strcmp(fn->name, "main") == 0;
+    int n = 0;
+    if (!fn->has_calls && !is_main) {
+        for (int r = FIRST_CALLEE_SAVED - 1; r >= MIN_TEMP_REGS; r--) {
+            regs[n++] = r;
+        }
+    }
+    for (int r = 14; r >= FIRST_CALLEE_SAVED; r--) {
+        regs[n++] = r;
+    }
+    if (!fn->has_calls && is_main) {
+        for (int r = FIRST_CALLEE_SAVED - 1; r >= MIN_TEMP_REGS; r--) {
+            regs[n++] = r;
+        }
+    }
+    return n;
+}
+
+// Put the most referenced locals of fn in registers and renumber the
+// rest. Return the number of frame slots still needed.
+long assign_local_regs(Compiler *cc, Function *fn) {
+    long n = fn->local_count;
+    LocalVar **vars = calloc(n ? n : 1, sizeof(LocalVar *));
+    if (!vars) {
+        error_nomem(cc);
+    }
+    long i = 0;
+    for (LocalVar *var = fn->locals; var; var = var->next) {
+        vars[i++] = var;
+    }
+    qsort(vars, n, sizeof(LocalVar *), compare_uses);
+
+    // Renumber the frame slots still used by memory locals.
+    // Locals that shared a slot (disjoint scopes) keep sharing one.
+    long max = fn->frame_slots;
+    long *slot_map = calloc(max + 1, sizeof(long));
+    if (!slot_map) {
+        free(vars);
+        error_nomem(cc);
+    }
+    int regs[MAX_REG_LOCALS];
+    int reg_count = local_regs(fn, regs);
+    bool is_main = strcmp(fn->name, "main") == 0;
+    cc->temp_regs = FIRST_CALLEE_SAVED;
+    fn->saved_regs = 0;
+    for (i = 0; i < n; i++) {
+        if (i < reg_count) {
+            int r = regs[i];
+            vars[i]->reg = r;
+            if (r < cc->temp_regs) {
+                cc->temp_regs = r;
+            } else if (r >= FIRST_CALLEE_SAVED && !is_main) {
+                fn->saved_regs |= 1u << r;
+            }
+        } else {
+            vars[i]->reg = -1;
+            slot_map[-vars[i]->offset] = 1;
+        }
+    }
+    long slots = 0;
+    for (long s = 1; s <= max; s++) {
+        if (slot_map[s]) {
+            slot_map[s] = ++slots;
+        }
+    }
+    for (i = reg_count; i < n; i++) {
+        vars[i]->offset = -slot_map[-vars[i]->offset];
+    }
+    free(slot_map);
+    free(vars);
+    return slots;
+}
+
+// Number of registers needed to evaluate node without spilling
+static int reg_need(Node *node) {
+    switch (node->type) {
+    case ND_NUM:
+    case ND_LOC_VAR:
+        return 1;
+    case ND_ASSIGN:
+        return reg_need(node->rhs);
+    case ND_CALL:
+        return 2; // evaluate before the other operand, so less is saved
+    default: {
+        int l = reg_need(node->lhs);
+        int r = reg_need(node->rhs);
+        int n = l == r ? l + 1 : (l > r ? l : r);
+        return n < 2 ? 2 : n;
+    }
+    }
+}
+
+static int gen_expr(Compiler *cc, Node *node);
+
+static bool is_reg_var(Node *node) {
+    return node->type == ND_LOC_VAR && node->var->reg >= 0;
+}
+
+// Evaluate node for reading only: register locals are used in place
+static int gen_operand(Compiler *cc, Node *node) {
+    if (is_reg_var(node)) {
+        return node->var->reg;
+    }
+    return gen_expr(cc, node);
+}
+
+// Evaluate second while *held is live, spilling *held if second
+// needs more temporaries than are free. Return second's register.
+static int gen_second(Compiler *cc, Node *second, int *held, bool writable) {
+    if (*held >= cc->temp_regs || reg_need(second) <= count_free_regs(cc)) {
+        return writable ? gen_expr(cc, second) : gen_operand(cc, second);
+    }
+    emit(cc, I_PUSH, 0, *held, 0);
+    free_reg(cc, *held);
+    int r = writable ? gen_expr(cc, second) : gen_operand(cc, second);
+    *held = alloc_reg(cc);
+    emit(cc, I_POP, *held, 0, 0);
+    return r;
+}
+
+// Evaluate dst = dst <op> src, dst writable; Sethi-Ullman order
+static void gen_operands(Compiler *cc, Node *dst_node, Node *src_node, int *dst, int *src) {
+    if (reg_need(src_node) > reg_need(dst_node)) {
+        *src = gen_operand(cc, src_node);
+        *dst = gen_second(cc, dst_node, src, true);
+    } else {
+        *dst = gen_expr(cc, dst_node);
+        *src = gen_second(cc, src_node, dst, false);
+    }
+}
+
+// Move src[i] to r(i+1) for every argument at once
+static void move_args(Compiler *cc, int *src, int n) {
+    bool done[MAX_PARAMS] = {false};
+    int left = n;
+    while (left > 0) {
+        bool progress = false;
+        for (int i = 0; i < n; i++) {
+            if (done[i]) {
+                continue;
+            }
+            bool blocked = false; // r(i+1) still holds another argument
+            for (int j = 0; j < n; j++) {
+                blocked |= !done[j] && j != i && src[j] == i + 1;
+            }
+            if (blocked) {
+                continue;
+            }
+            if (src[i] != i + 1) {
+                emit(cc, I_MOV, i + 1, src[i], 0);
+            }
+            free_reg(cc, src[i]);
+            cc->free_regs &= ~(1u << (i + 1));
+            done[i] = true;
+            left--;
+            progress = true;
+        }
+        if (!progress) {
+            // Only cycles are left: break one through a free temporary
+            for (int i = 0; i < n; i++) {
+                if (!done[i]) {
+                    int t = alloc_reg(cc);
+                    emit(cc, I_MOV, t, src[i], 0);
+                    free_reg(cc, src[i]);
+                    src[i] = t;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// x * y without mul calls MUL_ROUTINE (x * c is an add chain)
+static bool is_mul_call(Compiler *cc, Node *node) {
+    return node->type == ND_MUL && cc->opt_no_mul &&
+           node->lhs->type != ND_NUM && node->rhs->type != ND_NUM;
+}
+
+static bool has_call(Compiler *cc, Node *node) {
+    if (!node) {
+        return false;
+    }
+    return node->type == ND_CALL || is_mul_call(cc, node) ||
+           has_call(cc, node->lhs) || has_call(cc, node->rhs);
+}
+
+// Save the live temporaries, pass the arguments in r1.. and take
+// the result from r0. Arguments that make calls themselves are
+// evaluated first, so that fewer results have to be saved.
+static int gen_call(Compiler *cc, const char *label, Node **args, int n) {
+    unsigned live = ~cc->free_regs & ((1u << cc->temp_regs) - 1);
+    for (int r = 0; r < cc->temp_regs; r++) {
+        if (live & (1u << r)) {
+            emit(cc, I_PUSH, 0, r, 0);
+        }
+    }
+    unsigned free_regs = cc->free_regs;
+    cc->free_regs = (1u << cc->temp_regs) - 1;
+
+    int src[MAX_PARAMS];
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < n; i++) {
+            if (has_call(cc, args[i]) == (pass == 0)) {
+                src[i] = gen_operand(cc, args[i]);
+            }
+        }
+    }
+    move_args(cc, src, n);
+    emit_jump(cc, I_CALL, label, 0);
+
+    cc->free_regs = free_regs;
+    int r = alloc_reg(cc);
+    if (r != 0) {
+        emit(cc, I_MOV, r, 0, 0);
+    }
+    for (int q = cc->temp_regs - 1; q >= 0; q--) {
+        if (live & (1u << q)) {
+            emit(cc, I_POP, q, 0, 0);
+        }
+    }
+    return r;
+}
+
+// x * c as an add chain (see mul_digits)
+static int gen_mul_const(Compiler *cc, Node *x, long c) {
+    int digits[8];
+    int n = mul_digits(c, digits);
+    bool shift_only = n > 0 && digits[n - 1] > 0;
+    for (int i = 0; i < n - 1; i++) {
+        shift_only &= digits[i] == 0;
+    }
+    if (shift_only) {
+        int acc = gen_expr(cc, x); // doubled in place
+        for (int i = 0; i < n - 1; i++) {
+            emit(cc, I_ADD, acc, acc, 0);
+        }
+        return acc;
+    }
+
+    int xr = gen_operand(cc, x);
+    int acc = alloc_reg(cc);
+    if (n == 0) {
+        emit(cc, I_MVI, acc, 0, 0);
+    } else if (digits[n - 1] > 0) {
+        emit(cc, I_MOV, acc, xr, 0);
+    } else {
+        emit(cc, I_MVI, acc, 0, 0);
+        emit(cc, I_SUB, acc, xr, 0);
+    }
+    for (int i = n - 2; i >= 0; i--) {
+        emit(cc, I_ADD, acc, acc, 0);
+        if (digits[i]) {
+            emit(cc, digits[i] > 0 ? I_ADD : I_SUB, acc, xr, 0);
+        }
+    }
+    free_reg(cc, xr);
+    return acc;
+}
+
+// Return a temporary holding the value of node; the caller frees it
+static int gen_expr(Compiler *cc, Node *node) {
+    int r;
+    switch (node->type) {
+    case ND_NUM:
+        r = alloc_reg(cc);
+        emit(cc, I_MVI, r, 0, node->val);
+        return r;
+    case ND_LOC_VAR:
+        r = alloc_reg(cc);
+        if (node->var->reg >= 0) {
+            emit(cc, I_MOV, r, node->var->reg, 0);
+        } else {
+            emit(cc, I_LDM, r, 0, node->var->offset);
+        }
+        return r;
+    case ND_ASSIGN:
+        if (node->lhs->type != ND_LOC_VAR) {
+            error_at(cc, MINC_ERR_SYNTAX, node->lhs->loc, "Left-hand side of assignment must be a variable");
+        }
+        r = gen_expr(cc, node->rhs);
+        if (node->lhs->var->reg >= 0) {
+            emit(cc, I_MOV, node->lhs->var->reg, r, 0);
+        } else {
+            emit(cc, I_STM, 0, r, node->lhs->var->offset);
+        }
+        return r;
+    case ND_CALL: {
+        Node *args[MAX_PARAMS];
+        int n = 0;
+        for (Node *arg = node->args; arg; arg = arg->next) {
+            args[n++] = arg;
+        }
+        return gen_call(cc, node->func->name, args, n);
+    }
+    case ND_MUL:
+        if (!cc->opt_no_mul) {
+            break;
+        }
+        if (is_mul_call(cc, node)) {
+            cc->uses_mul_routine = true;
+            Node *args[] = {node->lhs, node->rhs};
+            return gen_call(cc, MUL_ROUTINE, args, 2);
+        }
+        return gen_mul_const(cc, node->lhs->type == ND_NUM ? node->rhs : node->lhs,
+                             node->lhs->type == ND_NUM ? node->lhs->val : node->rhs->val);
+    default:
+        break;
+    }
+
+    // lt only tests rd < rs, so > and <= evaluate with swapped operands.
+    // Commutative operators prefer a register local as the source operand
+    // so that it is read in place instead of copied.
+    bool swap = node->type == ND_GT || node->type == ND_LE;
+    bool commutative = node->type == ND_ADD || node->type == ND_MUL ||
+                       node->type == ND_EQ || node->type == ND_NEQ;
+    if (commutative && is_reg_var(node->lhs) && !is_reg_var(node->rhs)) {
+        swap = true;
+    }
+    int dst, src;
+    if (swap) {
+        gen_operands(cc, node->rhs, node->lhs, &dst, &src);
+    } else {
+        gen_operands(cc, node->lhs, node->rhs, &dst, &src);
+    }
+
+    switch (node->type) {
+    case ND_ADD:
+        emit(cc, I_ADD, dst, src, 0);
+        break;
+    case ND_SUB:
+    case ND_EQ:
+    case ND_NEQ:
+        emit(cc, I_SUB, dst, src, 0);
+        break;
+    case ND_MUL:
+        emit(cc, I_MUL, dst, src, 0);
+        break;
+    case ND_LT:
+    case ND_GT:
+    case ND_LE:
+    case ND_GE:
+        emit(cc, I_LT, dst, src, 0);
+        break;
+    default:
+        error_at(cc, MINC_ERR_INTERNAL, node->loc, "Unknown node type");
+        break;
+    }
+    free_reg(cc, src);
+
+    if (node->type == ND_EQ || node->type == ND_LE || node->type == ND_GE) {
+        // logical not: dst = dst < 1
+        int one = alloc_reg(cc);
+        emit(cc, I_MVI, one, 0, 1);
+        emit(cc, I_LT, dst, one, 0);
+        free_reg(cc, one);
+    } else if (node->type == ND_NEQ) {
+        // to bool: 0 < dst
+        int b = alloc_reg(cc);
+        emit(cc, I_MVI, b, 0, 0);
+        emit(cc, I_LT, b, dst, 0);
+        free_reg(cc, dst);
+        dst = b;
+    }
+    return dst;
+}
+
+void generate_reg(Compiler *cc, Node *node) {
+    cc->free_regs = (1u << cc->temp_regs) - 1;
+
+    if (node->type == ND_RETURN) {
+        int r = gen_operand(cc, node->lhs);
+        if (r != 0) {
+            emit(cc, I_MOV, 0, r, 0);
+        }
+        generate_epilogue(cc);
+        return;
+    }
+    free_reg(cc, gen_expr(cc, node));
+}
+
+// Jump to label if cond is true (if_true) or false, otherwise fall
+// through. Comparisons branch on the lt/sub result without turning it
+// into 0/1 first.
+void generate_branch_reg(Compiler *cc, Node *cond, const char *label, bool if_true) {
+    cc->free_regs = (1u << cc->temp_regs) - 1;
+
+    bool negate = false; // the lt/sub result is zero when cond holds
+    int r;
+    switch (cond->type) {
+    case ND_EQ:
+    case ND_NEQ:
+    case ND_LT:
+    case ND_LE:
+    case ND_GT:
+    case ND_GE: {
+        int dst, src;
+        if (cond->type == ND_GT || cond->type == ND_LE) {
+            gen_operands(cc, cond->rhs, cond->lhs, &dst, &src);
+        } else {
+            gen_operands(cc, cond->lhs, cond->rhs, &dst, &src);
+        }
+        bool is_eq = cond->type == ND_EQ || cond->type == ND_NEQ;
+        emit(cc, is_eq ? I_SUB : I_LT, dst, src, 0);
+        free_reg(cc, src);
+        negate = cond->type == ND_EQ || cond->type == ND_LE || cond->type == ND_GE;
+        r = dst;
+        break;
+    }
+    default:
+        r = gen_operand(cc, cond);
+        break;
+    }
+    emit_jump(cc, if_true != negate ? I_JNZ : I_JZ, label, r);
+    free_reg(cc, r);
+}
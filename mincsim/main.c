@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+// Cycle-accurate instruction-set simulator for the minc core (verilog/minc.sv).
+// Every instruction takes exactly one clock, so one step() == one cycle.
+// With -p the cycle count follows the two-stage core (PIPELINED = 1)
+// instead: one clock to fill the pipeline, +1 for pop, ldm and ret
+// (RAM read) and +1 whenever the next PC is not PC + 1 (taken branch,
+// call, ret).
+// -w sets the PC width (PC_WIDTH): the ROM holds 2^bits words, and with
+// more than 8 bits call/ret save the PC as two bytes, one per clock
+// (+1 cycle for call and ret on either core).
+
+#define ROM_SIZE 0x10000 // largest PC_WIDTH (16)
+#define RAM_SIZE 256
+#define HALT_WORD 0x7FFF
+
+// Performance counters, in debug port order (HAS_PERF in minc.sv)
+enum {
+    PERF_CYCLES, PERF_RETIRED, PERF_PUSH, PERF_POP, PERF_TAKEN,
+    PERF_NOT_TAKEN, PERF_CALL, PERF_RET, PERF_MEM, PERF_COUNT
+};
+
+typedef struct {
+    uint16_t pc;
+    uint8_t  sp;
+    uint8_t  regs[16];
+    uint16_t rom[ROM_SIZE];
+    uint8_t  ram[RAM_SIZE];
+    unsigned long cycles;
+    unsigned long perf[PERF_COUNT];
+    unsigned peak_stack;  // most RAM bytes below the initial SP (0) in use
+    uint8_t  page;        // high address byte from a page prefix
+    int page_valid;       // the previous instruction was a page prefix
+    int halted;
+    int has_mul;    // HAS_MUL parameter of minc.sv
+    int pipelined;  // PIPELINED parameter of minc.sv
+    int pc_width;   // PC_WIDTH parameter of minc.sv
+} Cpu;
+
+static void cpu_reset(Cpu *cpu) {
+    cpu->pc = 0;
+    cpu->sp = 0;
+    memset(cpu->regs, 0, sizeof(cpu->regs));
+    memset(cpu->ram, 0, sizeof(cpu->ram));
+    cpu->cycles = 0;
+    memset(cpu->perf, 0, sizeof(cpu->perf));
+    cpu->peak_stack = 0;
+    cpu->page_valid = 0;
+    cpu->halted = 0;
+}
+
+// Load a $readmemh-style image: whitespace separated hex words,
+// '//' comments and '@addr' directives. Unloaded words read as halt,
+// which matches the RTL where an X opcode falls into the halt case.
+static int load_hex(Cpu *cpu, FILE *fp) {
+    for (size_t i = 0; i < ROM_SIZE; i++) {
+        cpu->rom[i] = HALT_WORD;
+    }
+    size_t rom_size = (size_t)1 << cpu->pc_width;
+    char line[256];
+    size_t addr = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = line;
+        while (*p) {
+            if (isspace((unsigned char)*p)) {
+                p++;
+                continue;
+            }
+            if (p[0] == '/' && p[1] == '/') {
+                break; // comment till end of line
+            }
+            char *end;
+            if (*p == '@') {
+                addr = (size_t)strtoul(p + 1, &end, 16);
+            } else {
+                unsigned long word = strtoul(p, &end, 16);
+                if (end == p) {
+                    fprintf(stderr, "Error: Invalid hex word '%s'\n", p);
+                    return 0;
+                }
+                if (addr >= rom_size) {
+                    fprintf(stderr, "Error: Program too large (more than %zu words)\n", rom_size);
+                    return 0;
+                }
+                cpu->rom[addr++] = (uint16_t)(word & 0x7FFF);
+            }
+            p = end;
+        }
+    }
+    return 1;
+}
+
+// Execute one instruction (one clock edge of minc.sv)
+static void step(Cpu *cpu, int trace) {
+    uint16_t instr = cpu->rom[cpu->pc];
+    int op    = (instr >> 12) & 0x7;
+    int subop = (instr >> 8) & 0xF;
+    int rd    = (op & 1) ? (instr & 0xF) : ((instr >> 4) & 0xF);
+    int rs    = instr & 0xF;
+    uint8_t imm8 = (uint8_t)((instr >> 4) & 0xFF);
+    uint8_t *r = cpu->regs;
+    uint16_t pc_mask = (uint16_t)((1u << cpu->pc_width) - 1);
+    uint16_t next_pc = (uint16_t)((cpu->pc + 1) & pc_mask);
+    // jz/jnz/call: the page prefix or the branch's own page, plus imm8
+    uint16_t target = (uint16_t)(((cpu->page_valid ? cpu->page : cpu->pc >> 8) << 8 | imm8) & pc_mask);
+    cpu->page_valid = 0;
+
+    cpu->cycles++;
+    switch (op) {
+    case 0:
+        switch (subop) {
+        case 0x0: // mov rd,rs
+            if (trace) printf("mov r%d, r%d\n", rd, rs);
+            r[rd] = r[rs];
+            break;
+        case 0x1: // add rd,rs
+            if (trace) printf("add r%d, r%d\n", rd, rs);
+            r[rd] = (uint8_t)(r[rd] + r[rs]);
+            break;
+        case 0x2: // sub rd,rs
+            if (trace) printf("sub r%d, r%d\n", rd, rs);
+            r[rd] = (uint8_t)(r[rd] - r[rs]);
+            break;
+        case 0x3: // lt rd,rs : 9-bit borrow of rd - rs, i.e. unsigned compare
+            if (trace) printf("lt r%d, r%d\n", rd, rs);
+            r[rd] = r[rd] < r[rs] ? 1 : 0;
+            break;
+        case 0x4: // mul rd,rs (no-op on a core built with HAS_MUL = 0)
+            if (trace) printf("mul r%d, r%d\n", rd, rs);
+            if (cpu->has_mul) {
+                r[rd] = (uint8_t)(r[rd] * r[rs]);
+            }
+            break;
+        case 0x8: // push rs
+            if (trace) printf("push r%d\n", rs);
+            cpu->perf[PERF_PUSH]++;
+            cpu->perf[PERF_MEM]++;
+            cpu->sp--;
+            cpu->ram[cpu->sp] = r[rs];
+            break;
+        case 0x9: // sts rs : SP = rs
+            if (trace) printf("sts r%d\n", rs);
+            cpu->sp = r[rs];
+            break;
+        case 0xA: // pop rd
+            if (trace) printf("pop r%d\n", rd);
+            cpu->perf[PERF_POP]++;
+            cpu->perf[PERF_MEM]++;
+            r[rd] = cpu->ram[cpu->sp++];
+            cpu->cycles += cpu->pipelined;
+            break;
+        case 0xB: // lds rd : rd = SP
+            if (trace) printf("lds r%d\n", rd);
+            r[rd] = cpu->sp;
+            break;
+        case 0xC: { // ret : PC = (SP++) + 1
+            if (trace) printf("ret\n");
+            cpu->perf[PERF_RET]++;
+            cpu->perf[PERF_MEM]++;
+            uint16_t ret_pc = cpu->ram[cpu->sp++];
+            if (cpu->pc_width > 8) {
+                ret_pc |= (uint16_t)(cpu->ram[cpu->sp++] << 8);
+                cpu->cycles++;
+            }
+            next_pc = (uint16_t)((ret_pc + 1) & pc_mask);
+            cpu->cycles += cpu->pipelined;
+            break;
+        }
+        case 0xD: // page p : high address byte of the next jz/jnz/call
+            if (trace) printf("page 0x%x\n", instr & 0xFF);
+            cpu->page = (uint8_t)(instr & 0xFF);
+            cpu->page_valid = 1;
+            break;
+        default:
+            // no-op for undefined subops in this group
+            break;
+        }
+        break;
+    case 1: // mvi rd,n
+        if (trace) printf("mvi r%d, 0x%x\n", rd, imm8);
+        r[rd] = imm8;
+        break;
+    case 2: // stm n,rs : [r15+n] = rs
+        if (trace) printf("stm 0x%x, r%d\n", imm8, rs);
+        cpu->perf[PERF_MEM]++;
+        cpu->ram[(uint8_t)(r[15] + imm8)] = r[rs];
+        break;
+    case 3: // ldm rd,n : rd = [r15+n]
+        if (trace) printf("ldm 0x%x, r%d\n", imm8, rd);
+        cpu->perf[PERF_MEM]++;
+        r[rd] = cpu->ram[(uint8_t)(r[15] + imm8)];
+        cpu->cycles += cpu->pipelined;
+        break;
+    case 4: // jz n,rs
+        if (trace) printf("jz 0x%x, r%d\n", imm8, rs);
+        if (r[rs] == 0) next_pc = target;
+        cpu->perf[r[rs] == 0 ? PERF_TAKEN : PERF_NOT_TAKEN]++;
+        break;
+    case 5: // call n : (--sp) = PC; PC = n (high byte pushed first when wider)
+        if (trace) printf("call 0x%x\n", imm8);
+        cpu->perf[PERF_CALL]++;
+        cpu->perf[PERF_MEM]++;
+        if (cpu->pc_width > 8) {
+            cpu->ram[--cpu->sp] = (uint8_t)(cpu->pc >> 8);
+            cpu->cycles++;
+        }
+        cpu->ram[--cpu->sp] = (uint8_t)cpu->pc;
+        next_pc = target;
+        break;
+    case 6: // jnz n,rs
+        if (trace) printf("jnz 0x%x, r%d\n", imm8, rs);
+        if (r[rs] != 0) next_pc = target;
+        cpu->perf[r[rs] != 0 ? PERF_TAKEN : PERF_NOT_TAKEN]++;
+        break;
+    default: // 111: halt, PC stays on the halt instruction
+        if (trace) printf("halt\n");
+        cpu->halted = 1;
+        return;
+    }
+    cpu->perf[PERF_RETIRED]++;
+    unsigned depth = (uint8_t)(0 - cpu->sp);
+    if (depth > cpu->peak_stack) {
+        cpu->peak_stack = depth;
+    }
+    if (cpu->pipelined && next_pc != ((cpu->pc + 1) & pc_mask)) {
+        cpu->cycles++; // the word fetched behind this one is dropped
+    }
+    cpu->pc = next_pc;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: mincsim [-t] [-s] [-p] [-w bits] [-mno-mul] [-c max_cycles] [file.hex]\n");
+    fprintf(stderr, "  -t             print every executed instruction\n");
+    fprintf(stderr, "  -s             print the performance counters (HAS_PERF = 1) and peak stack depth\n");
+    fprintf(stderr, "  -p             count cycles of the pipelined core (PIPELINED = 1)\n");
+    fprintf(stderr, "  -w bits        PC width, 8..16 (PC_WIDTH, default 8)\n");
+    fprintf(stderr, "  -mno-mul       model a core without multiplier (mul is a no-op)\n");
+    fprintf(stderr, "  -c max_cycles  stop after max_cycles clocks (default 1000000)\n");
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    unsigned long max_cycles = 1000000;
+    int trace = 0;
+    int stats = 0;
+    int has_mul = 1;
+    int pipelined = 0;
+    int pc_width = 8;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0) {
+            trace = 1;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            stats = 1;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            pipelined = 1;
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            char *end;
+            pc_width = (int)strtol(argv[++i], &end, 0);
+            if (*end != '\0' || pc_width < 8 || pc_width > 16) {
+                fprintf(stderr, "Error: Invalid PC width '%s'\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-mno-mul") == 0) {
+            has_mul = 0;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            char *end;
+            max_cycles = strtoul(argv[++i], &end, 0);
+            if (*end != '\0' || max_cycles == 0) {
+                fprintf(stderr, "Error: Invalid cycle count '%s'\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            usage();
+            return EXIT_FAILURE;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    static Cpu cpu;
+    cpu_reset(&cpu);
+    cpu.has_mul = has_mul;
+    cpu.pipelined = pipelined;
+    cpu.pc_width = pc_width;
+    cpu.cycles = pipelined; // first fetch
+
+    FILE *fp = stdin;
+    if (path && strcmp(path, "-") != 0) {
+        fp = fopen(path, "r");
+        if (!fp) {
+            fprintf(stderr, "Error: Cannot open '%s'\n", path);
+            return EXIT_FAILURE;
+        }
+    }
+    int ok = load_hex(&cpu, fp);
+    if (fp != stdin) fclose(fp);
+    if (!ok) return EXIT_FAILURE;
+
+    while (!cpu.halted && cpu.cycles < max_cycles) {
+        step(&cpu, trace);
+    }
+    if (!cpu.halted) {
+        printf("Timeout reached, finishing simulation.\n");
+    }
+
+    // Same summary as the final block of minc_tb.sv
+    printf("PC: %x, TOP: %x, SP: %x\n", cpu.pc, cpu.ram[cpu.sp], cpu.sp);
+    printf("Cycles: %lu\n", cpu.cycles);
+    if (stats) {
+        // The counters stop on the clock edge before the halt
+        unsigned long *perf = cpu.perf;
+        perf[PERF_CYCLES] = cpu.cycles - cpu.halted;
+        printf("Counters: cycles=%lu retired=%lu push=%lu pop=%lu taken=%lu not_taken=%lu call=%lu ret=%lu mem=%lu\n",
+               perf[PERF_CYCLES], perf[PERF_RETIRED], perf[PERF_PUSH], perf[PERF_POP], perf[PERF_TAKEN],
+               perf[PERF_NOT_TAKEN], perf[PERF_CALL], perf[PERF_RET], perf[PERF_MEM]);
+        printf("Peak stack: %u\n", cpu.peak_stack);
+    }
+
+    return cpu.halted ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,49 @@
+// Drives libminc in-process: several compilations in one process,
+// and errors come back as status codes instead of exiting.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "minc.h"
+
+// Names the compiler uses internally: only the minc_* API is exported,
+// so a client may define its own
+int expr;
+void error(void) {}
+
+static int build(const char *src, int opt_level) {
+    MincOptions opts = {0};
+    opts.opt_level = opt_level;
+    char *asm_text;
+    int status = minc_compile_opts(src, strlen(src), &opts, &asm_text);
+    if (status != MINC_OK) {
+        printf("compile: %s\n", minc_strerror(status));
+        return status;
+    }
+    MincWords words;
+    status = minc_assemble_opts(asm_text, strlen(asm_text), &opts, &words);
+    free(asm_text);
+    if (status != MINC_OK) {
+        printf("assemble: %s\n", minc_strerror(status));
+        return status;
+    }
+    printf("%zu words, first %04X\n", words.count, words.data[0]);
+    free(words.data);
+    return status;
+}
+
+int main(void) {
+    build("a=1;b=2;return a+b;", 0);
+    build("a=1;b=2;return a+b;", 2); // no state left over from the first run
+    build("a+1=5;", 0);
+    build("return 256;", 0);
+    build("int f() { return 1; }", 0); // no main
+
+    MincOptions opts = {0};
+    MincWords words;
+    const char *bad[] = {"jz L,r0", "L: ret\nL: ret", "mvi r0,300", "foo"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        printf("%s\n", minc_strerror(minc_assemble_opts(bad[i], strlen(bad[i]), &opts, &words)));
+    }
+    return 0;
+}
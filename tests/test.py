@@ -1,5 +1,34 @@
 import testfuncs as tf
 
+def balanced_sum(n:int, first:int=1) -> str:
+    # (1+2)+(3+4)... as a balanced tree, deep enough to force spills
+    if n == 1:
+        return str(first)
+    return f"({balanced_sum(n // 2, first)}+{balanced_sum(n - n // 2, first + n // 2)})"
+
+def check_no_mul(cases:list, flags:str):
+    for code, _ in cases:
+        words = tf.build(code, flags).split()
+        assert not any(0x0400 <= int(w, 16) <= 0x04FF for w in words), f"""[FAIL] mul emitted with {flags} for "{code}" """
+    print(f"""[OK] no mul instruction with {flags}""")
+
+def check_emit_hex(cases:list, flags:str):
+    for code, _ in cases:
+        assert tf.build(code, flags) == tf.build_via_asm(code, flags), f"""[FAIL] --emit=hex differs from mincc | mincasm for "{code}" {flags}"""
+    print(f"""[OK] --emit=hex matches mincc | mincasm {flags}""")
+
+def check_timeout_rejected():
+    # Batch line of minc_tb.sv and single-run output: vvp exits 0 after a timeout
+    for sim_output in ("PC: 0, TOP: 0, SP: ff, Cycles: 100000, Status: timeout",
+                       "Timeout reached, finishing simulation.\nPC: 0, TOP: 0, SP: ff\nCycles: 100000"):
+        try:
+            tf.check_top("timeout", 0, sim_output)
+        except Exception:
+            continue
+        raise AssertionError(f"""[FAIL] timeout accepted: {sim_output}""")
+    assert tf.parse_result("PC: 2, TOP: 5, SP: ff, Cycles: 3, Status: halted")["TOP"] == 5, "[FAIL] halted batch line rejected"
+    print("[OK] timeout results are rejected")
+
 if __name__ == "__main__":
     # MINCASM tests
     tf.expect("""echo "mov r0,r1\nadd r2,r3\nsub r4,r5\nlt r6,r7\nmul r7,r8" | ./target/mincasm""", 
@@ -25,31 +54,186 @@ if __name__ == "__main__":
                 "5020\n7FFF\n0C00")
     # Undefined label should fail
     tf.expect_fail("""echo "jz NO_SUCH_LABEL,r0" | ./target/mincasm""")
+    tf.expect_fail("""echo "L0: ret\nL0: ret" | ./target/mincasm""") # Duplicate label
+    tf.expect("""(for i in $(seq 5000); do echo "L$i:"; done; echo "jz L4999,r0\nL0: call L1") | ./target/mincasm""",
+                "4000\n5000") # Many labels, found through the symbol hash
+    tf.expect("""(echo "jz L,r0"; yes "mov r0,r0" | head -n 300; echo "L: halt") | ./target/mincasm | head -n 2""",
+                "0D01\n42E0") # Label in another page: page prefix (far branch), label after it moves by one
+    tf.expect("""(yes "mov r0,r0" | head -n 300; echo "L: jz L,r0") | ./target/mincasm | tail -n 1""",
+                "42C0") # Same page: near branch
+    tf.expect_fail("""(yes "mov r0,r0" | head -n 70000) | ./target/mincasm""") # More than 64K words
+    # MINCASM output formats
+    tf.expect("""echo "mvi r0,5\npush r0\nhalt" | ./target/mincasm -f memb""",
+                "001000001010000\n000100000000000\n111111111111111")
+    tf.expect("""echo "mvi r0,5\npush r0\nhalt" | ./target/mincasm -f ihex""",
+                ":0600000050100008FF7F14\n:00000001FF")
+    tf.expect("""echo "mvi r0,5\npush r0\nhalt" | ./target/mincasm -f bin | od -An -tx1""",
+                "50 10 00 08 ff 7f")
+    tf.expect("""echo "mvi r0,5\npush r0\nhalt" | ./target/mincasm -f packed | od -An -tx1""",
+                "50 10 00 c4 ff 1f") # 3 x 15 bits in 6 bytes
+    tf.expect("""echo "halt" | ./target/mincasm -o $SCRATCH/out.hex && cat $SCRATCH/out.hex""",
+                "7FFF")
+    tf.expect_fail("""echo "halt" | ./target/mincasm -f foo""") # Unknown format
+    # libminc: several builds in one process, errors as status codes
+    tf.expect("""gcc -std=c99 -Iinclude tests/libminc_test.c target/libminc.a -o $SCRATCH/libminc_test && $SCRATCH/libminc_test""",
+                "32 words, first 5030\n8 words, first 5030\ncompile: syntax error\ncompile: value out of range\ncompile: syntax error\n"
+                "undefined or duplicate label\nundefined or duplicate label\nvalue out of range\nsyntax error")
+    tf.expect("""nm -g --defined-only target/libminc.a | awk 'NF == 3 && $3 !~ /^minc_/' | wc -l""",
+                "0") # Only the minc_* API is exported
+    # MINCSIM tests
+    tf.expect("""echo "mvi r0,5\npush r0\nhalt" | ./target/mincasm | ./target/mincsim""",
+                "PC: 2, TOP: 5, SP: ff\nCycles: 3") # Stops on halt and reports state
+    tf.expect("""echo "mvi r0,3\ncall F\npush r0\nhalt\nF: mvi r1,4\nmul r0,r1\nret" | ./target/mincasm | ./target/mincsim""",
+                "PC: 3, TOP: c, SP: ff\nCycles: 7") # call/ret returns to the word after call
+    tf.expect("""echo "mvi r0,3\ncall F\npush r0\nhalt\nF: mvi r1,4\nmul r0,r1\nret" | ./target/mincasm | ./target/mincsim -p""",
+                "PC: 3, TOP: c, SP: ff\nCycles: 11") # Pipelined core: fill +1, call +1, ret +2
+    tf.expect("""echo "mvi r0,3\ncall F\npush r0\nhalt\nF: mvi r1,4\nmul r0,r1\njz F,r1\nret" | ./target/mincasm | ./target/mincsim -s""",
+                "PC: 3, TOP: c, SP: ff\nCycles: 8\n"
+                "Counters: cycles=7 retired=7 push=1 pop=0 taken=0 not_taken=1 call=1 ret=1 mem=3\nPeak stack: 1") # Performance counters
+    tf.expect_fail("""echo "L0: jz L0,r0" | ./target/mincasm | ./target/mincsim -c 100""") # Timeout
+    tf.expect("""echo "mvi r0,3\ncall F\npush r0\nhalt\nF: mvi r1,4\nmul r0,r1\nret" | ./target/mincasm | ./target/mincsim -w 12 -s | tail -n 1""",
+                "Peak stack: 2") # Wide PC: call saves two bytes
+    tf.expect("""echo "0D01\n4100" | ./target/mincsim -w 9 -t""",
+                "page 0x1\njz 0x10, r0\nhalt\nPC: 110, TOP: 0, SP: 0\nCycles: 3") # page 1; jz 0x10,r0: far jump to 0x110
+    big = "int main() { int s = 0; int i = 0; while (i < 3) { " + "s = s + 1; " * 100 + "i = i + 1; } return s; }"
+    tf.expect(f"""echo "{big}" | ./target/mincc --emit=hex | ./target/mincsim -w 12""",
+                "PC: 2, TOP: 2c, SP: ff\nCycles: 3700") # Loop body spans pages
+    tf.expect_fail(f"""echo "{big}" | ./target/mincc --emit=hex | ./target/mincsim""") # Too large for an 8-bit PC
+    tf.expect(f"""[ "$(echo "{big}" | ./target/mincc -O1 --emit=hex)" = "$(echo "{big}" | ./target/mincc -O1 | ./target/mincasm)" ] && echo same""",
+                "same") # Both relax branches the same way
     # MINCC tests
     tf.expect_fail("""echo "1+" | ./target/mincc""") # Incomplete expression
     tf.expect_fail("""echo "a+1=5;" | ./target/mincc""") # Invalid assignment
+    tf.expect_fail("""echo "return 1;" | ./target/mincc -O9""") # Unknown option
+    tf.expect_fail("""echo "return 1!2;" | ./target/mincc""") # Invalid token
+    tf.expect_fail("""./target/mincc no_such_file.c""") # Missing input file
+    tf.expect_fail("""echo "int a; int a; return 0;" | ./target/mincc""") # Redeclaration in the same scope
+    tf.expect_fail("""echo "if (1) return 1" | ./target/mincc""") # Missing ';'
+    tf.expect_fail("""echo "{ return 1;" | ./target/mincc""") # Missing '}'
+    tf.expect_fail("""echo "return f(1);" | ./target/mincc""") # Undefined function
+    tf.expect_fail("""echo "int f(int a) { return a; } int main() { return f(); }" | ./target/mincc""") # Wrong number of arguments
+    tf.expect_fail("""echo "int f(int a, int b, int c, int d, int e) { return a; } int main() { return 0; }" | ./target/mincc""") # Too many parameters
+    tf.expect_fail("""echo "int f(); int main() { return f(); }" | ./target/mincc""") # Declared but never defined
+    tf.expect_fail("""echo "int f() { return 1; } int f() { return 2; } int main() { return f(); }" | ./target/mincc""") # Redefinition
+    tf.expect_fail("""echo "int f() { return 1; }" | ./target/mincc""") # No main
+    tf.expect("""(yes "a=1;" | head -n 300; echo "return a;") | ./target/mincc | tail -n 1""",
+                "ret") # More than 256 statements
+    tf.expect("""for i in $(seq 200); do echo "v$i=$i;"; done | ./target/mincc | grep -m 1 mvi""",
+                "mvi r0,56") # 200 locals (-200 & 0xFF): the table grows past its first size
+    for flags, slots in (("", 300), ("-O2", 291)): # -O2 keeps 9 of them in registers
+        tf.expect(f"""for i in $(seq 300); do echo "v$i=1;"; done | ./target/mincc {flags} 2>&1 >/dev/null | grep -o "Too many.*" """,
+                    f"Too many local variables in 'main' ({slots} frame slots, at most 253)") # Frame larger than the RAM
+        tf.expect_fail(f"""for i in $(seq 300); do echo "v$i=1;"; done | ./target/mincc {flags}""")
+    tf.expect("""echo "return 7;" | ./target/mincc /dev/stdin | ./target/mincasm | ./target/mincsim""",
+                "PC: 2, TOP: 7, SP: ff\nCycles: 7") # Input from a (non-seekable) file
+    tf.expect("""echo "return 7;" | ./target/mincc --emit=bin | od -An -tx1 | head -n 1""",
+                "30 50 00 08 ff 7f 70 10 00 08 00 0a 00 0c") # Direct machine code: call main, push r0, halt, ...
+    tf.expect_fail("""echo "return 7;" | ./target/mincc --emit=elf""") # Unknown emit kind
+    tf.expect("""echo "int f(int a) { int b; b = a; return b; } int main() { x = 1; return f(x); }" | ./target/mincc --stats 2>&1 >/dev/null | grep frame""",
+                "[Stats]: f: frame 2, saved 0\n[Stats]: main: frame 1, saved 0") # Frame sizes from the prologue
+    tf.expect("""echo "return 1;" | ./target/mincc -O2 --stats 2>&1 >/dev/null | grep Time | cut -d' ' -f2""",
+                "tokenize\nparse\nfold\ncodegen\npeephole\nemit") # Phase times
+    tf.expect("""echo "halt" | ./target/mincasm --stats 2>&1 >/dev/null | grep Time | cut -d' ' -f2""",
+                "assemble\nresolve")
+    tf.expect("""python3 bench/scale.py --sizes 10,100 --flags=-O2 > /dev/null && echo ok""",
+                "ok") # Scaling benchmark on small generated inputs
+    tf.expect("""echo "return (1+2)*3;" | ./target/mincc -O1""",
+                "call main\npush r0\nhalt\nmain:\nmvi r0,9\nret") # Constant folding, no frame without locals
+    tf.expect("""echo "a=1;return a*a;" | ./target/mincc -O1""",
+                "call main\npush r0\nhalt\nmain:\npush r15\nlds r15\nmvi r0,-1\nadd r0,r15\nsts r0\nmvi r0,1\nstm -1,r0\nldm r0,-1\nldm r1,-1\nmul r0,r1\nsts r15\npop r15\nret") # Peephole: push/pop forwarding
+
+    tf.expect("""echo "int sq(int x) { return x*x; } int main() { return sq(5); }" | ./target/mincc -O2""",
+                "call main\npush r0\nhalt\nsq:\nmov r7,r1\nmov r0,r7\nmul r0,r7\nret\nmain:\nmvi r1,5\ncall sq\nret") # Frameless leaf, argument in r1
+    tf.expect("""echo "a=9;return a*10;" | ./target/mincc -O2 -mno-mul""",
+                "call main\npush r0\nhalt\nmain:\nmvi r14,9\nmov r0,r14\nadd r0,r0\nadd r0,r0\nadd r0,r14\nadd r0,r0\nret") # -mno-mul: 10 = 0b1010 as an add chain
+    tf.expect("""echo "mvi r0,3\nmvi r1,4\nmul r0,r1\npush r0\nhalt" | ./target/mincasm | ./target/mincsim -mno-mul""",
+                "PC: 4, TOP: 3, SP: ff\nCycles: 5") # mul is a no-op without multiplier
+    tf.expect("""echo "s=0;for (i=0;i<10;i=i+1) s=s+i; return s;" | ./target/mincc -O2""",
+                "call main\npush r0\nhalt\nmain:\nmvi r13,0\nmvi r14,0\nmov r0,r14\nmvi r1,10\nlt r0,r1\njz _L1,r0\n_L0:\nmov r0,r13\nadd r0,r14\nmov r13,r0\nmvi r0,1\nadd r0,r14\nmov r14,r0\nmvi r1,10\nlt r0,r1\njnz _L0,r0\n_L1:\nmov r0,r13\nret") # Loop inversion: one jnz per iteration
+
+    # E2E tests (one simulator batch for the whole list)
+    e2e_cases = [
+        ("return 1+2;", 3),
+        ("return 10-3;", 7),
+        ("return 2*3;", 6),
+        ("return (1+2)*3;", 9),
+        ("return -3+5;", 2),
+        ("return -(2+3)*4;", -20),
+        ("return +5+(+3);", 8),
+        ("return 1+1==2;", 1),
+        ("return 1+1==3;", 0),
+        ("return 2*2!=5;", 1),
+        ("return 2*2!=4;", 0),
+        ("return 3+2<6;", 1),
+        ("return 3+3<=6;", 1),
+        ("return 5>2+2;", 1),
+        ("return 2+2>=4;", 1),
+        ("return 2<=3;", 1),
+        ("return 3<=2;", 0),
+        ("return 3>=2;", 1),
+        ("return 2>=3;", 0),
+        ("returnx=4;return returnx;", 4), # keyword prefix is an identifier
+        ("a=7;" + " " * 300 + "return a;", 7), # line longer than 255 characters
+        ("a=3;return a+2;", 5),
+        ("a=2;b=3;return a*b;", 6),
+        ("hoge=4;fuga=5;return hoge+fuga;", 9),
+        ("a=1;\nb=2;\nc=3;\nreturn a+b*c;", 7),
+        ("a=b=4;return a*b-a;", 12),
+        ("a=7;return 3<a;", 1),
+        ("a=7;return a<3;", 0),
+        ("a=1;b=2;c=3;d=4;e=5;f=6;g=7;h=8;i=9;j=10;k=11;return a+b+c+d+e+f+g+h+i+j+k;", 66),
+        ("return 3-5<2;", 0), # 8-bit wraparound, unsigned compare
+        ("return 200+100;", 44),
+        ("return 16*16+1;", 1),
+        ("a=5;return 0-(0-a)+0*a+1*a;", 10),
+        ("a=3;return ((a+1)+2)-3;", 3),
+        ("a=2;return (a=7)*0+a;", 7), # x*0 keeps the side effect
+        ("a=3;if (a==3) return 1; return 2;", 1),
+        ("a=3;if (a!=3) return 1; return 2;", 2),
+        ("a=3;if (a<2) b=1; else b=2; return b;", 2),
+        ("a=3;if (a>2) b=1; else b=2; return b;", 1),
+        ("a=3;if (a<=3) b=1; else b=2; return b;", 1),
+        ("a=3;if (a>=4) b=1; else if (a) b=2; else b=3; return b;", 2),
+        ("if (0) return 1; else return 2;", 2),
+        ("i=0;s=0;while (i<10) s=s+(i=i+1); return s;", 55),
+        ("s=0;for (i=0;i<=10;i=i+1) s=s+i; return s;", 55),
+        ("s=0;for (i=0;i<5;i=i+1) for (j=0;j<i;j=j+1) s=s+j; return s;", 10),
+        ("n=0;while (0) n=1; return n;", 0),
+        ("i=0;for (;;) { i=i+1; if (i==7) return i; }", 7),
+        ("i=5;while (i) { i=i-1; } return i;", 0),
+        ("int a=1; { int a=2; { int a=3; } b=a; } return a*10+b;", 12),
+        ("s=0;for (i=0;i<3;i=i+1) { int t=i*2; s=s+t; } { int u=4; s=s+u; } return s;", 10),
+        ("int x; x=4; ; {} return x;", 4),
+        ("int sq(int x) { return x*x; } int main() { return sq(5)+sq(2); }", 29),
+        ("int fib(int n) { if (n<2) return n; return fib(n-1)+fib(n-2); } int main() { return fib(10); }", 55),
+        ("int sub(int a, int b) { return a-b; } int swap(int a, int b) { return sub(b, a); } int main() { return swap(3, 10); }", 7),
+        ("int f(int a, int b, int c, int d) { return a*8+b*4+c*2+d; } int main() { return f(f(0,0,0,1), 1, f(0,0,1,0), 1); }", 17),
+        ("int odd(int n); int even(int n) { if (n==0) return 1; return odd(n-1); } int odd(int n) { if (n==0) return 0; return even(n-1); } int main() { return even(7)*10+odd(7); }", 1),
+        ("int g(int x) { return x+1; } int main() { int a=1; int b=2; int c=3; int d=4; int e=5; int f=6; int h=7; int i=8; return a+b+c+d+e+f+h+i+g(i)*g(h); }", 108),
+        ("int none() { } int main() { return none()+3; }", 3), # falling off the end returns 0
+    ]
+    tf.test_e2e_batch(e2e_cases)
+    tf.test_e2e_batch(e2e_cases + [
+        # Needs 7 temporaries while only 6 are left: spills (too large for the stack code generator)
+        ("a=1;b=2;c=3;d=4;e=5;f=6;g=7;h=8;i=9;j=10;return " + balanced_sum(64) + "+j*i;", 2080 + 90),
+    ], "-fregalloc")
+    tf.test_e2e_batch(e2e_cases, "-O1")
+    tf.test_e2e_batch(e2e_cases, "-O2")
+
+    # Core without multiplier: constant factors become add chains, the rest calls __mul
+    mul_cases = [(f"x=7;return x*{c};", 7 * c) for c in (0, 1, 2, 3, 5, 7, 8, 15, 100, 128, 170, 200, 254, 255)] + [
+        ("a=13;b=11;return a*b;", 143),
+        ("a=255;b=255;return a*b;", 1),
+        ("a=0;b=9;return a*b+b*a;", 0),
+        ("int p(int a, int b, int c) { return a*b*c; } int main() { int x=3; return p(x, x*x, 2)*5; }", 270),
+        ("int f(int n) { if (n < 2) return 1; return n * f(n-1); } int main() { return f(5); }", 120),
+        ("int f(int a,int b){int x=a+1;int y=a*b;return x+y;} int main(){return f(3,4);}", 16), # Leaf local in r6 across __mul
+    ]
+    for flags in ("-mno-mul", "-O2 -mno-mul"):
+        tf.test_e2e_batch(e2e_cases + mul_cases, flags)
+        tf.add_case(f"no mul instruction with {flags}", check_no_mul, e2e_cases + mul_cases, flags)
+    for flags in ("", "-O2", "-O2 -mno-mul"):
+        tf.add_case(f"--emit=hex matches mincc | mincasm {flags}", check_emit_hex, e2e_cases, flags)
+    tf.add_case("timeout results are rejected", check_timeout_rejected)
 
-    # E2E tests
-    tf.test_e2e("return 1+2;", 3)
-    tf.test_e2e("return 10-3;", 7)
-    tf.test_e2e("return 2*3;", 6)
-    tf.test_e2e("return (1+2)*3;", 9)
-    tf.test_e2e("return -3+5;", 2)
-    tf.test_e2e("return -(2+3)*4;", -20)
-    tf.test_e2e("return +5+(+3);", 8)
-    tf.test_e2e("return 1+1==2;", 1)
-    tf.test_e2e("return 1+1==3;", 0)
-    tf.test_e2e("return 2*2!=5;", 1)
-    tf.test_e2e("return 2*2!=4;", 0)
-    tf.test_e2e("return 3+2<6;", 1)
-    tf.test_e2e("return 3+3<=6;", 1)
-    tf.test_e2e("return 5>2+2;", 1)
-    tf.test_e2e("return 2+2>=4;", 1)
-    tf.test_e2e("a=3;return a+2;", 5)
-    tf.test_e2e("a=2;b=3;return a*b;", 6)
-    tf.test_e2e("hoge=4;fuga=5;return hoge+fuga;", 9)
-    tf.test_e2e("a=1;\nb=2;\nc=3;\nreturn a+b*c;", 7)
-
-
-    print()
-    print("[OK] [ALL TESTS PASSED]")
+    tf.run_all()
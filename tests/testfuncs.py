@@ -1,9 +1,45 @@
+import concurrent.futures
+import contextlib
+import fcntl
+import io
+import os
+import shutil
 import subprocess
+import sys
+import tempfile
+import time
+
+# Test cases are queued by expect / expect_fail / test_e2e / test_e2e_batch / add_case
+# and run by run_all() on a process pool. Each case runs in its own scratch
+# directory (scratch_dir()), so cases never share a hex file or simulator image.
+# Shell commands of expect / expect_fail find it in $SCRATCH.
+_cases = []
+_scratch = None
+
+def add_case(name:str, func, *args):
+    # func must be a module-level function (it is sent to a worker process)
+    _cases.append((name, func, args))
+
+def scratch_dir() -> str:
+    # Private directory of the running case, removed when it finishes
+    return _scratch
+
+def escape(text:str) -> str:
+    return text.replace("\n", "\\n").replace("\r", "\\r")
 
 def expect(command:str, expected_output:str):
+    add_case(escape(command), _expect, command, expected_output)
+
+def expect_fail(command:str):
+    add_case(escape(command), _expect_fail, command)
+
+def _shell(command:str) -> subprocess.CompletedProcess:
+    return subprocess.run(command, shell=True, capture_output=True, text=True, env=dict(os.environ, SCRATCH=scratch_dir()))
+
+def _expect(command:str, expected_output:str):
     escaped_expected_output = expected_output.replace("\n", "\\n").replace("\r", "\\r")
     output = ""
-    result = subprocess.run(command, shell=True, capture_output=True, text=True)
+    result = _shell(command)
     output = result.stdout.strip()
     error  = result.stderr.strip()
 
@@ -15,9 +51,9 @@ def expect(command:str, expected_output:str):
     assert output == expected_output, f"""[FAIL] Expected: "{escaped_expected_output}", but got: "{escaped_output}" """
     print(f"""[OK] "{escaped_command}" => "{escaped_output}" """)
 
-def expect_fail(command:str):
+def _expect_fail(command:str):
 
-    result = subprocess.run(command, shell=True, capture_output=True, text=True)
+    result = _shell(command)
     output = result.stdout.strip()
     error  = result.stderr.strip()
 
@@ -28,33 +64,220 @@ def expect_fail(command:str):
     assert result.returncode != 0, f"""[FAIL] Expected failure but command succeeded: "{command}" """
     print(f"""[OK] "{escaped_command}" failed as expected with output: "{escaped_output}"\nand stderr: "{escaped_error}" """)
 
-def test_e2e(code:str, expected_top:int, verbose:bool=False):
-    output = ""
-    
-    asm = subprocess.run("./target/mincc", input=code, shell=True, capture_output=True, text=True)
+# Simulator backend for test_e2e: "mincsim" (native ISS, default), "iverilog" (RTL)
+# or "verilator" (RTL compiled by make verilator)
+SIM_BACKEND = os.environ.get("MINC_SIM", "mincsim")
+# MINC_PIPELINED=1 runs the e2e tests on the two-stage core (PIPELINED = 1)
+PIPELINED = os.environ.get("MINC_PIPELINED", "0") == "1"
+# MINC_PC_WIDTH=<bits> runs the e2e tests on a core with a wider PC (PC_WIDTH)
+PC_WIDTH = int(os.environ.get("MINC_PC_WIDTH", "8"))
+# Cycle budget per program
+MAX_CYCLES = 100000
+
+def run_mincsim(hex_code:str, has_mul:bool=True) -> str:
+    flags = ([] if has_mul else ["-mno-mul"]) + (["-p"] if PIPELINED else []) + ([] if PC_WIDTH == 8 else ["-w", str(PC_WIDTH)])
+    sim = subprocess.run(["./target/mincsim", "-c", str(MAX_CYCLES)] + flags, input=hex_code, capture_output=True, text=True)
+    if sim.returncode != 0:
+        raise Exception(f"mincsim failed with return code {sim.returncode}:\nStdout: {sim.stdout.strip()}\nStderr: {sim.stderr.strip()}")
+    return sim.stdout
+
+_iverilog_compiled = set()
+
+def compile_iverilog(has_mul:bool=True) -> str:
+    # The RTL only has to be elaborated once per session and core configuration;
+    # programs are passed with +HEX / +LIST
+    out = "__minc_test" + ("" if has_mul else "_nomul") + ("_pipe" if PIPELINED else "") + ("" if PC_WIDTH == 8 else f"_pc{PC_WIDTH}") + ".out"
+    if out in _iverilog_compiled:
+        return out
+    params = [f"-Pminc_tb.HAS_MUL={int(has_mul)}", f"-Pminc_tb.PIPELINED={int(PIPELINED)}", f"-Pminc_tb.PC_WIDTH={PC_WIDTH}"]
+    # Workers may elaborate the same configuration at once: write a private
+    # file and rename it into place
+    tmp = f"{out}.{os.getpid()}"
+    synsesis = subprocess.run(["iverilog", "-o", tmp, *params, "minc.sv", "minc_tb.sv", "-g2005-sv"], cwd="./verilog", capture_output=True, text=True)
+    if synsesis.returncode != 0:
+        raise Exception(f"Verilog synthesis failed with return code {synsesis.returncode}:\nStderr: {synsesis.stderr.strip()}")
+    os.replace(os.path.join("verilog", tmp), os.path.join("verilog", out))
+    _iverilog_compiled.add(out)
+    return out
+
+def run_vvp(*plusargs:str, has_mul:bool=True) -> str:
+    out = compile_iverilog(has_mul)
+    verilog_sim = subprocess.run(["vvp", "./" + out, f"+CYCLES={MAX_CYCLES}", *plusargs], cwd="./verilog", capture_output=True, text=True)
+    if verilog_sim.returncode != 0:
+        raise Exception(f"Verilog simulation failed with return code {verilog_sim.returncode}:\nStderr: {verilog_sim.stderr.strip()}")
+    return verilog_sim.stdout
+
+def run_iverilog(hex_code:str, has_mul:bool=True) -> str:
+    hex_path = os.path.join(scratch_dir(), "test.hex")
+    with open(hex_path, "w") as f:
+        f.write(hex_code)
+    return run_vvp(f"+HEX={hex_path}", has_mul=has_mul)
+
+def run_iverilog_batch(hex_codes:list, has_mul:bool=True) -> list:
+    # One vvp process for all programs; the testbench resets the core between them
+    list_path = os.path.join(scratch_dir(), "list.txt")
+    with open(list_path, "w") as lst:
+        for i, hex_code in enumerate(hex_codes):
+            hex_path = os.path.join(scratch_dir(), f"{i}.hex")
+            with open(hex_path, "w") as f:
+                f.write(hex_code)
+            lst.write(f"{hex_path}\n")
+    results = [None] * len(hex_codes)
+    for line in run_vvp(f"+LIST={list_path}", has_mul=has_mul).splitlines():
+        if line.startswith("["):
+            index, result = line[1:].split("] ", 1)
+            results[int(index)] = result
+    if None in results:
+        raise Exception(f"Batch simulation returned no result for program {results.index(None)}")
+    return results
+
+_verilator_built = set()
+
+def build_verilator(has_mul:bool=True) -> str:
+    # One model per core configuration, built once per session
+    binary = "./target/minc_vl" + ("" if has_mul else "_nomul") + ("_pipe" if PIPELINED else "") + ("" if PC_WIDTH == 8 else f"_pc{PC_WIDTH}")
+    if binary not in _verilator_built:
+        # Serialize the build across workers; make skips it once it is up to date
+        with open("target/.verilator.lock", "w") as lock:
+            fcntl.flock(lock, fcntl.LOCK_EX)
+            build = subprocess.run(["make", "-s", "verilator", f"VL_HAS_MUL={int(has_mul)}", f"VL_PIPELINED={int(PIPELINED)}", f"VL_PC_WIDTH={PC_WIDTH}"], capture_output=True, text=True)
+        if build.returncode != 0:
+            raise Exception(f"Verilator build failed with return code {build.returncode}:\nStderr: {build.stderr.strip()}")
+        _verilator_built.add(binary)
+    return binary
+
+def run_verilator(hex_code:str, has_mul:bool=True) -> str:
+    binary = build_verilator(has_mul)
+    hex_path = os.path.join(scratch_dir(), "test.hex")
+    with open(hex_path, "w") as f:
+        f.write(hex_code)
+    sim = subprocess.run([binary, "-c", str(MAX_CYCLES), hex_path], capture_output=True, text=True)
+    if sim.returncode != 0:
+        raise Exception(f"Verilator model failed with return code {sim.returncode}:\nStdout: {sim.stdout.strip()}\nStderr: {sim.stderr.strip()}")
+    return sim.stdout
+
+SIMULATORS = {
+    "mincsim": run_mincsim,
+    "iverilog": run_iverilog,
+    "verilator": run_verilator,
+}
+
+BATCH_SIMULATORS = {
+    "mincsim": lambda hex_codes, has_mul=True: [run_mincsim(h, has_mul) for h in hex_codes],
+    "iverilog": run_iverilog_batch,
+    "verilator": lambda hex_codes, has_mul=True: [run_verilator(h, has_mul) for h in hex_codes],
+}
+
+def parse_result(sim_output:str) -> dict:
+    # "PC: 2, TOP: 5, SP: ff" [+ "Cycles: 3"] -> {"PC": 2, "TOP": 5, "SP": 255, "Cycles": 3}
+    # A program that did not halt is an error: batch lines carry "Status: timeout",
+    # single runs print "Timeout reached" (vvp exits 0 in both cases)
+    result = {}
+    status = "halted"
+    for line in sim_output.strip().splitlines():
+        if line.startswith("Timeout reached"):
+            status = "timeout"
+        elif line.startswith("PC: ") or line.startswith("Cycles: "):
+            for field in line.split(", "):
+                key, value = field.split(": ")
+                if key == "Status":
+                    status = value
+                else:
+                    result[key] = int(value, 10 if key == "Cycles" else 16)
+    if "TOP" not in result:
+        raise Exception(f"No result line in simulator output:\n{sim_output}")
+    if status != "halted":
+        raise Exception(f"Program did not halt within {MAX_CYCLES} cycles ({status}):\n{sim_output}")
+    return result
+
+def build(code:str, mincc_flags:str="") -> str:
+    # mincc encodes the program itself; see build_via_asm for the text path
+    hex_code = subprocess.run(f"./target/mincc --emit=hex {mincc_flags}", input=code, shell=True, capture_output=True, text=True)
+    if hex_code.returncode != 0:
+        raise Exception(f"mincc failed with return code {hex_code.returncode}:\nStderr:\n{hex_code.stderr}")
+    return hex_code.stdout
+
+def build_via_asm(code:str, mincc_flags:str="") -> str:
+    asm = subprocess.run(f"./target/mincc {mincc_flags}", input=code, shell=True, capture_output=True, text=True)
     if asm.returncode != 0:
         raise Exception(f"mincc failed with return code {asm.returncode}:\nStderr:\n{asm.stderr}")
     asm_code = asm.stdout
     inst = subprocess.run("./target/mincasm", input=asm_code, shell=True, capture_output=True, text=True)
     if inst.returncode != 0:
         raise Exception(f"mincasm failed with return code {inst.returncode}:\nStderr:\n{inst.stderr}")
-    with open("verilog/test.hex", "w") as f:
-        f.write(inst.stdout)
-    synsesis = subprocess.run(["iverilog", "-o", "__minc_test.out", "minc.sv", "minc_tb.sv", "-g2005-sv", "-DTEST", "-DVERBOSE"], cwd="./verilog", capture_output=True, text=True)
-    if synsesis.returncode != 0:
-        raise Exception(f"Verilog synthesis failed with return code {synsesis.returncode}:\nStderr: {synsesis.stderr.strip()}")
-    verilog_sim = subprocess.run(["vvp", "./__minc_test.out"], cwd="./verilog", capture_output=True, text=True)
-    if verilog_sim.returncode != 0:
-        raise Exception(f"Verilog simulation failed with return code {verilog_sim.returncode}:\nStderr: {verilog_sim.stderr.strip()}")
+    return inst.stdout
+
+def check_top(code:str, expected_top:int, sim_output:str, mincc_flags:str=""):
+    top_value = parse_result(sim_output)["TOP"]
+    assert top_value == (expected_top & 0xff), f"""[FAIL] Expected TOP: {expected_top}, but got: {top_value} ({mincc_flags}) """
+    print(f"""[OK] E2E test for code "{code}" {mincc_flags} => TOP: {top_value} """)
+
+def _test_e2e(code:str, expected_top:int, verbose:bool=False):
+    sim_output = SIMULATORS[SIM_BACKEND](build(code))
     if verbose:
-        print(verilog_sim.stdout)
-    output = verilog_sim.stdout.strip().splitlines()[-1]  # Get the last line of output
-    pc_str, top_str, sp_str = output.split(", ")
-    top_value = int(top_str.split(": ")[1], 16)
-    assert top_value == (expected_top & 0xff), f"""[FAIL] Expected TOP: {expected_top}, but got: {top_value} """
-    print(f"""[OK] E2E test for code "{code}" => TOP: {top_value} """)
+        print(sim_output)
+    check_top(code, expected_top, sim_output)
+
+def _test_e2e_batch(cases:list, mincc_flags:str=""):
+    hex_codes = [build(code, mincc_flags) for code, _ in cases]
+    has_mul = "-mno-mul" not in mincc_flags.split()
+    for (code, expected_top), sim_output in zip(cases, BATCH_SIMULATORS[SIM_BACKEND](hex_codes, has_mul)):
+        check_top(code, expected_top, sim_output, mincc_flags)
+
+def test_e2e(code:str, expected_top:int, verbose:bool=False):
+    add_case(f"e2e {escape(code)}", _test_e2e, code, expected_top, verbose)
+
+def test_e2e_batch(cases:list, mincc_flags:str=""):
+    # cases: [(code, expected_top), ...]
+    # -mno-mul code runs on a core without multiplier
+    if SIM_BACKEND == "iverilog":
+        # One vvp run for the whole list: elaboration and startup dominate
+        add_case(f"e2e batch of {len(cases)} {mincc_flags}", _test_e2e_batch, cases, mincc_flags)
+    else:
+        for case in cases:
+            add_case(f"e2e {escape(case[0])} {mincc_flags}", _test_e2e_batch, [case], mincc_flags)
+
+def _run_case(case:tuple) -> tuple:
+    # Runs in a worker: (captured output, error or None, wall time in seconds)
+    global _scratch
+    _, func, args = case
+    _scratch = tempfile.mkdtemp(prefix="minc_test_")
+    output = io.StringIO()
+    error = None
+    start = time.perf_counter()
+    try:
+        with contextlib.redirect_stdout(output):
+            func(*args)
+    except Exception as e:
+        error = str(e) or type(e).__name__
+    finally:
+        shutil.rmtree(_scratch, ignore_errors=True)
+    return output.getvalue(), error, time.perf_counter() - start
+
+def run_all(jobs:int=0):
+    # Run the queued cases on jobs workers (MINC_JOBS, default: all cores),
+    # print each case's output and wall time in order, then a summary.
+    # Exits with status 1 if any case failed.
+    jobs = jobs or int(os.environ.get("MINC_JOBS", "0")) or os.cpu_count() or 1
+    start = time.perf_counter()
+    failed = []
+    with concurrent.futures.ProcessPoolExecutor(jobs) as pool:
+        for (name, _, _), (output, error, elapsed) in zip(_cases, pool.map(_run_case, _cases)):
+            print(output, end="")
+            if error:
+                print(error)
+                failed.append(name)
+            print(f"""[{"FAIL" if error else "OK"} {elapsed * 1000:.0f} ms] {name[:100]}""")
+    print()
+    print(f"{len(_cases) - len(failed)} passed, {len(failed)} failed, {len(_cases)} cases in {time.perf_counter() - start:.1f} s on {jobs} workers")
+    if failed:
+        for name in failed:
+            print(f"[FAIL] {name[:100]}")
+        sys.exit(1)
+    print("[OK] [ALL TESTS PASSED]")
 
 if __name__ == "__main__":
     expect("""echo "Hello World!" """, "Hello World!")
     expect_fail("cat non_existent_file.txt")
-    test_e2e("1+2", 3, verbose=True)
\ No newline at end of file
+    test_e2e("return 1+2;", 3, verbose=True)
+    run_all()
\ No newline at end of file
@@ -1,37 +1,104 @@
-module minc (
+// HAS_MUL = 0 leaves out the 8x8 multiplier: mul becomes a no-op
+// (compile with mincc -mno-mul).
+//
+// PIPELINED = 1 selects the two-stage core: the next word is fetched
+// while the current one executes, and ROM and RAM are only read on a
+// clock edge so that both map to block RAM. Hazards stall the core,
+// so programs run unchanged and only take more cycles:
+//   taken jz/jnz, call : +1 (the word fetched after it is dropped)
+//   pop, ldm           : +1 (RAM read)
+//   ret                : +2 (RAM read, then the dropped fetch)
+//   call, ret          : +1 more with PC_WIDTH > 8 (see below)
+// plus one cycle after reset to fetch the first word.
+//
+// HAS_PERF = 1 adds 32-bit performance counters, cleared by reset and
+// read through the debug port (dbg_data = counter[dbg_sel], 0 for an
+// unused index or without HAS_PERF):
+//   0 cycles     clocks since reset
+//   1 retired    executed instructions (not bubbles or stalls)
+//   2 push       push instructions
+//   3 pop        pop instructions
+//   4 taken      jz/jnz that jumped
+//   5 not taken  jz/jnz that fell through
+//   6 call       call instructions
+//   7 ret        ret instructions
+//   8 mem        RAM accesses (push, pop, call, ret, stm, ldm)
+//
+// PC_WIDTH (8..16) sets the program address space to 2^PC_WIDTH words.
+// jz/jnz/call keep their 8-bit target and stay in their own 256-word
+// page; a page prefix (page p, 000 1101 pppp pppp) in front of one
+// supplies the high byte instead (far branch, one more word and cycle).
+// With PC_WIDTH > 8, call pushes the return address as two bytes (high
+// byte first, so the low byte is on top) and ret pops both. The bytes
+// move one per cycle through the single RAM port, so call and ret take
+// one more cycle (the first one stalls like a load).
+module minc #(
+    parameter bit HAS_MUL   = 1'b1,
+    parameter bit PIPELINED = 1'b0,
+    parameter bit HAS_PERF  = 1'b0,
+    parameter int PC_WIDTH  = 8
+) (
     input  logic        CLK,
     input  logic        nRESET,
-    output logic [7:0]  pc_out,
+    output logic [PC_WIDTH-1:0] pc_out,
     output logic [7:0]  top_out,
-    output logic [7:0]  sp_out
+    output logic [7:0]  sp_out,
+    output logic        halted,
+    input  logic [3:0]  dbg_sel,
+    output logic [31:0] dbg_data
 );
 
-    // PC, SP
-    logic  [7:0] pc;
+    localparam int  ROM_WORDS = 1 << PC_WIDTH;
+    localparam bit  WIDE_PC   = PC_WIDTH > 8;
+
+    // PC (of the instruction in execute), SP
+    logic  [PC_WIDTH-1:0] pc;
     logic  [7:0] sp;
 
+    // Page prefix: high address byte for the next jz/jnz/call
+    logic  [7:0] page;
+    logic        page_valid;
+
     // General purpose registers r0..r15 (8-bit)
     logic  [7:0]  regs [0:15];
 
-    // Instruction ROM: 256 words x 15-bit (instruction is 15-bit)
-    logic  [14:0] rom  [0:255];
+    // Instruction ROM: 2^PC_WIDTH words x 15-bit (instruction is 15-bit)
+    logic  [14:0] rom  [0:ROM_WORDS-1];
     // Data RAM: 256 x 8-bit (stack and data unified)
     logic  [7:0]  ram  [0:255];
 
-    // ROM load (one word per line, hex). TEST selects test.hex
-    `ifdef TEST
-    initial $readmemh("test.hex", rom);
-    `else
-    initial $readmemh("program.hex", rom);
-    `endif
+    // ROM load (one word per line, hex). +HEX=<file> selects the image,
+    // otherwise TEST selects test.hex. Words past the end of the image
+    // read as halt, also under simulators without X (Verilator).
+    reg [8*256-1:0] hex_path;
+    integer k;
+    initial begin
+        for (k = 0; k < ROM_WORDS; k = k + 1) begin
+            rom[k] = 15'h7fff;
+        end
+        if (!$value$plusargs("HEX=%s", hex_path)) begin
+            `ifdef TEST
+            hex_path = "test.hex";
+            `else
+            hex_path = "program.hex";
+            `endif
+        end
+        $readmemh(hex_path, rom);
+    end
+
+    // Fetch stage (PIPELINED only)
+    logic  [PC_WIDTH-1:0] fetch_pc; // address of the word being fetched
+    logic  [14:0] instr_q;    // registered ROM output
+    logic         ex_valid;   // instr_q holds an instruction to execute
+    logic         load_phase; // second cycle of pop, ldm or ret
+    logic  [7:0]  ram_q;      // registered RAM output
 
-    // Outputs
-    assign pc_out  = pc;
-    assign sp_out  = sp;
-    assign top_out = ram[sp]; // current stack top
+    // Two-byte call/ret (PC_WIDTH > 8)
+    logic         hi_phase;   // the high byte of the return address is done
+    logic  [7:0]  ret_hi;     // high byte read by ret
 
-    // Fetch current instruction (15-bit in [14:0])
-    wire [14:0] instr = rom[pc];
+    // Instruction in execute (15-bit in [14:0]); a bubble is mov r0,r0
+    wire [14:0] instr = PIPELINED ? (ex_valid ? instr_q : 15'h0000) : rom[pc];
 
     // Decode fields
     wire [2:0] op    = instr[14:12];
@@ -44,147 +111,348 @@ module minc (
     wire [7:0] rs_val = regs[rs];
     integer i;
 
+    wire is_call = op == 3'b101;
+    wire is_ret  = op == 3'b000 && subop == 4'b1100;
+
+    // Memory reads: pop and ret read [SP], ldm reads [r15+n]. A two-byte
+    // ret reads the high byte at [SP+1] first.
+    wire       is_load   = (op == 3'b000 && (subop == 4'b1010 || subop == 4'b1100)) || op == 3'b011;
+    wire [7:0] mem_addr  = op == 3'b011 ? regs[15] + imm8 : (WIDE_PC && is_ret && !hi_phase) ? sp + 8'd1 : sp;
+    wire [7:0] mem_rdata = PIPELINED ? ram_q : ram[mem_addr];
+
+    // Return address of ret: [SP], and ret_hi from [SP+1] with PC_WIDTH > 8
+    wire [15:0] ret_pc  = {WIDE_PC ? ret_hi : 8'd0, mem_rdata} + 16'd1;
+
+    // Branch target: imm8 in the page of the prefix, or else in the
+    // branch's own page
+    wire [15:0] pc_wide = pc;
+    wire [15:0] target  = {page_valid ? page : pc_wide[15:8], imm8};
+    wire        is_page = op == 3'b000 && subop == 4'b1101;
+
+    // A load waits one cycle for its data, and a two-byte call/ret one
+    // cycle for its high byte; nothing else changes meanwhile.
+    // A halt (op 111) stops the core for good: PC stays on it.
+    wire hi_stall   = WIDE_PC && (!PIPELINED || ex_valid) && (is_call || is_ret) && !hi_phase;
+    wire load_stall = PIPELINED && ex_valid && is_load && !load_phase && !hi_stall;
+    wire stall   = hi_stall || load_stall;
+    wire halt    = (!PIPELINED || ex_valid) && op == 3'b111;
+    wire execute = !stall && !halt && (!PIPELINED || ex_valid);
+
     // Next PC logic
-    logic [7:0] next_pc;
+    logic [PC_WIDTH-1:0] next_pc;
     always_comb begin
         if (op == 3'b000) begin
             if (subop == 4'b1100) begin
                 // ret instruction special case: next_pc from stack
-                next_pc = ram[sp] + 8'd1;
+                next_pc = ret_pc[PC_WIDTH-1:0];
             end else begin
-                next_pc = pc + 8'd1;
+                next_pc = pc + 1'b1;
             end
         end else if (op == 3'b100) begin
             // jz
             if (regs[rs] == 8'd0) begin
-                next_pc = imm8;
+                next_pc = target[PC_WIDTH-1:0];
             end else begin
-                next_pc = pc + 8'd1;
+                next_pc = pc + 1'b1;
             end
         end else if (op == 3'b101) begin
             // call
-            next_pc = imm8;
+            next_pc = target[PC_WIDTH-1:0];
         end else if (op == 3'b110) begin
             // jnz
             if (regs[rs] != 8'd0) begin
-                next_pc = imm8;
+                next_pc = target[PC_WIDTH-1:0];
             end else begin
-                next_pc = pc + 8'd1;
+                next_pc = pc + 1'b1;
             end
         end else begin
-            next_pc = pc + 8'd1;
+            next_pc = pc + 1'b1;
+        end
+    end
+
+    // Next SP
+    logic [7:0] sp_next;
+    always_comb begin
+        sp_next = sp;
+        if (execute) begin
+            if (op == 3'b000) begin
+                case (subop)
+                    4'b1000: sp_next = sp - 8'd1;          // push
+                    4'b1001: sp_next = regs[rs];           // sts
+                    4'b1010: sp_next = sp + 8'd1;          // pop
+                    4'b1100: sp_next = sp + (WIDE_PC ? 8'd2 : 8'd1); // ret
+                    default: ;
+                endcase
+            end else if (op == 3'b101) begin
+                sp_next = sp - (WIDE_PC ? 8'd2 : 8'd1);  // call
+            end
+        end
+    end
+
+    // RAM write port: push, call, stm. A two-byte call writes the high
+    // byte of the return address in its first cycle.
+    logic       ram_we;
+    logic [7:0] ram_waddr;
+    logic [7:0] ram_wdata;
+    always_comb begin
+        ram_we    = 1'b0;
+        ram_waddr = sp - 8'd1;
+        ram_wdata = regs[rs];
+        if (nRESET && hi_stall && is_call) begin
+            ram_we    = 1'b1;                            // call: high byte at [SP-1]
+            ram_wdata = pc_wide[15:8];
+        end else if (nRESET && execute) begin
+            if (op == 3'b000 && subop == 4'b1000) begin
+                ram_we = 1'b1;                           // push rs
+            end else if (op == 3'b101) begin
+                ram_we    = 1'b1;                        // call: return address
+                ram_waddr = sp - (WIDE_PC ? 8'd2 : 8'd1);
+                ram_wdata = pc_wide[7:0];
+            end else if (op == 3'b010) begin
+                ram_we    = 1'b1;                        // stm n,rs
+                ram_waddr = regs[15] + imm8;
+            end
+        end
+    end
+
+    // The registered read port of the pipelined core serves the load of
+    // a stall cycle, and otherwise the next stack top for top_out
+    wire [7:0] ram_raddr = stall ? mem_addr : sp_next;
+    always_ff @(posedge CLK) begin
+        if (ram_we) begin
+            ram[ram_waddr] <= ram_wdata;
+        end
+        ram_q <= ram[ram_raddr];
+    end
+
+    // ret_hi holds the high byte once it has been read: at the end of
+    // the first cycle of ret, or of the second on the pipelined core
+    always_ff @(posedge CLK) begin
+        if (WIDE_PC && is_ret && (PIPELINED ? hi_phase && load_stall : hi_stall)) begin
+            ret_hi <= mem_rdata;
+        end
+    end
+
+    always_ff @(posedge CLK) begin
+        if (!stall && !halt) begin
+            instr_q <= rom[fetch_pc];
         end
     end
 
+    // Outputs. The pipelined core takes the stack top from the read port,
+    // forwarding a word written on the same edge. After a stall cycle the
+    // port holds load data instead; SP and [SP] did not change in that
+    // cycle, so the previous top is kept.
+    logic [7:0] top_wdata;
+    logic       top_forward;
+    logic       top_valid;
+    logic [7:0] top_hold;
+    wire  [7:0] top_q = top_forward ? top_wdata : ram_q;
+    always_ff @(posedge CLK) begin
+        top_wdata   <= ram_wdata;
+        top_forward <= ram_we && ram_waddr == sp_next;
+        top_valid   <= !stall;
+        top_hold    <= top_out;
+    end
+
+    assign pc_out  = pc;
+    assign sp_out  = sp;
+    assign halted  = halt;
+    assign top_out = PIPELINED ? (top_valid ? top_q : top_hold) : ram[sp]; // current stack top
+
+    // Performance counters
+    localparam int N_PERF = 9;
+    logic [31:0] perf [0:N_PERF-1];
+    wire is_branch = op == 3'b100 || op == 3'b110;
+    wire taken     = (op == 3'b100 && regs[rs] == 8'd0) || (op == 3'b110 && regs[rs] != 8'd0);
+    wire is_push   = op == 3'b000 && subop == 4'b1000;
+    wire is_pop    = op == 3'b000 && subop == 4'b1010;
+    wire is_mem    = is_push || is_pop || is_call || is_ret || op == 3'b010 || op == 3'b011;
+
+    generate
+        if (HAS_PERF) begin : g_perf
+            integer j;
+            always_ff @(posedge CLK or negedge nRESET) begin
+                if (!nRESET) begin
+                    for (j = 0; j < N_PERF; j = j + 1) begin
+                        perf[j] <= 32'd0;
+                    end
+                end else begin
+                    perf[0] <= perf[0] + 32'd1;
+                    if (execute) begin
+                        perf[1] <= perf[1] + 32'd1;
+                        if (is_push)             perf[2] <= perf[2] + 32'd1;
+                        if (is_pop)              perf[3] <= perf[3] + 32'd1;
+                        if (is_branch && taken)  perf[4] <= perf[4] + 32'd1;
+                        if (is_branch && !taken) perf[5] <= perf[5] + 32'd1;
+                        if (is_call)             perf[6] <= perf[6] + 32'd1;
+                        if (is_ret)              perf[7] <= perf[7] + 32'd1;
+                        if (is_mem)              perf[8] <= perf[8] + 32'd1;
+                    end
+                end
+            end
+        end
+    endgenerate
+
+    assign dbg_data = HAS_PERF && dbg_sel < N_PERF ? perf[dbg_sel] : 32'd0;
+
     always_ff @(posedge CLK or negedge nRESET) begin
         if (!nRESET) begin
-            pc <= 8'h00;
+            pc <= '0;
             sp <= 8'h00;
+            fetch_pc <= '0;
+            ex_valid <= 1'b0;
+            load_phase <= 1'b0;
+            hi_phase <= 1'b0;
+            page_valid <= 1'b0;
             // Clear registers for deterministic startup
             for (i = 0; i < 16; i = i + 1) begin
                 regs[i] <= 8'h00;
             end
         end else begin
-            // Default next PC is sequential (one word per instruction)
+            sp <= sp_next;
+            load_phase <= load_stall;
+            hi_phase <= stall && (is_call || is_ret); // until the call/ret executes
+            if (execute) begin
+                page_valid <= is_page; // a prefix applies to the next instruction only
+            end
 
             // Execute
+            if (execute) begin
+                case (op)
+                    3'b000: begin
+                        // subop-based operations
+                        case (subop)
+                            4'b0000: begin
+                                // mov rd,rs : rd = rs
+                                regs[rd] <= regs[rs];
+                            end
+                            4'b0001: begin
+                                // add rd,rs : rd = rd + rs
+                                regs[rd] <= regs[rd] + regs[rs];
+                            end
+                            4'b0010: begin
+                                // sub rd,rs : rd = rd - rs
+                                regs[rd] <= regs[rd] - regs[rs];
+                            end
+                            4'b0011: begin
+                                // lt rd,rs : set registers for comparison (rd - rs)
+                                regs[rd] <= regs[rd] - regs[rs] > 9'b1_0000_0000 ? 8'b1 : 8'b0;
+                            end
+                            4'b0100: begin
+                                // mul rd,rs : rd = rd * rs
+                                if (HAS_MUL) begin
+                                    regs[rd] <= regs[rd] * regs[rs];
+                                end
+                            end
+                            4'b1000: begin
+                                // push rs : (--sp) = rs  (pattern 000 1000 0000 ssss)
+                            end
+                            4'b1001: begin
+                                // lds rs : SP = rs (pattern 000 0100 0001 ssss)
+                            end
+                            4'b1010: begin
+                                // pop rd : rd = (SP++) (pattern 000 0101 dddd 0000)
+                                regs[rd] <= mem_rdata;
+                            end
+                            4'b1011: begin
+                                // sts rd : rd = SP (pattern 000 0101 dddd 0001)
+                                regs[rd] <= sp;
+                            end
+                            4'b1100: begin
+                                // ret : PC = (SP++) + 1 (pattern 000 0101 0000 0010)
+                            end
+                            4'b1101: begin
+                                // page p : high address byte of the next jz/jnz/call (pattern 000 1101 pppp pppp)
+                                page <= instr[7:0];
+                            end
+                            default: begin
+                                // no-op for undefined subops in this group
+                            end
+                        endcase
+                    end
+                    3'b001: begin
+                        // mvi rd, n : rd = n
+                        regs[rd] <= imm8;
+                    end
+                    3'b010: begin
+                        // stm n, rs : [r15 + n] = rs
+                    end
+                    3'b011: begin
+                        // ldm n, rd : rd = [r15 + n]
+                        regs[rd] <= mem_rdata;
+                    end
+                    3'b100: begin
+                        // jz n, rs : PC = n if rs == 0
+                    end
+                    3'b101: begin
+                        // call n : (--sp) = PC; PC = n  (low nibble must be 0000)
+                    end
+                    3'b110: begin
+                        // jnz n, rs : PC = n if rs != 0
+                    end
+                    default: begin
+                        // 111: unused -> HALT (see halt above; never executed)
+                    end
+                endcase
+            end
+
+            // Commit next PC
+            if (!PIPELINED) begin
+                if (!stall && !halt) begin
+                    pc <= next_pc;
+                end
+            end else if (!stall && !halt) begin
+                if (ex_valid && next_pc != fetch_pc) begin
+                    // Taken branch, call or ret: drop the word being fetched
+                    fetch_pc <= next_pc;
+                    ex_valid <= 1'b0;
+                end else begin
+                    pc <= fetch_pc;
+                    fetch_pc <= fetch_pc + 1'b1;
+                    ex_valid <= 1'b1;
+                end
+            end
+        end
+    end
+
+`ifdef TRACE
+    // Per-instruction trace (define TRACE, e.g. iverilog -DTRACE)
+    logic halt_shown;
+    always_ff @(posedge CLK or negedge nRESET) begin
+        if (!nRESET) begin
+            halt_shown <= 1'b0;
+        end else if (halt && !halt_shown) begin
+            $display("halt");
+            halt_shown <= 1'b1;
+        end else if (execute) begin
             case (op)
                 3'b000: begin
-                    // subop-based operations
                     case (subop)
-                        4'b0000: begin
-                            // mov rd,rs : rd = rs
-                            regs[rd] <= regs[rs];
-                            $display("mov r%0d, r%0d", rd, rs);
-                        end
-                        4'b0001: begin
-                            // add rd,rs : rd = rd + rs
-                            regs[rd] <= regs[rd] + regs[rs];
-                            $display("add r%0d, r%0d", rd, rs);
-                        end
-                        4'b0010: begin
-                            // sub rd,rs : rd = rd - rs
-                            regs[rd] <= regs[rd] - regs[rs];
-                            $display("sub r%0d, r%0d", rd, rs);
-                        end
-                        4'b0011: begin
-                            // lt rd,rs : set registers for comparison (rd - rs)
-                            regs[rd] <= regs[rd] - regs[rs] > 9'b1_0000_0000 ? 8'b1 : 8'b0;
-                            $display("lt r%0d, r%0d", rd, rs);
-                        end
-                        4'b0100: begin
-                            // mul rd,rs : rd = rd * rs
-                            regs[rd] <= regs[rd] * regs[rs];
-                            $display("mul r%0d, r%0d", rd, rs);
-                        end
-                        4'b1000: begin
-                            // push rs : (--sp) = rs  (pattern 000 1000 0000 ssss)
-                            ram[sp - 8'd1] <= regs[rs];
-                            sp <= sp - 8'd1; // wrap naturally (8-bit)
-                            $display("push r%0d", rs);
-                        end
-                        4'b1001: begin
-                            // lds rs : SP = rs (pattern 000 0100 0001 ssss)
-                            sp <= regs[rs];
-                            $display("lds r%0d", rs);
-                        end
-                        4'b1010: begin
-                            // pop rd : rd = (SP++) (pattern 000 0101 dddd 0000)
-                            $display("pop r%0d", rd);
-                            regs[rd] <= ram[sp];
-                            sp <= sp + 8'd1;
-                        end
-                        4'b1011: begin
-                            // sts rd : rd = SP (pattern 000 0101 dddd 0001)
-                            regs[rd] <= sp;
-                            $display("sts r%0d", rd);
-                        end
-                        4'b1100: begin
-                            // ret : PC = (SP++) + 1 (pattern 000 0101 0000 0010)
-                            next_pc = ram[sp] + 8'd1;
-                            sp <= sp + 8'd1;
-                            $display("ret");
-                        end
-                        default: begin
-                            // no-op for undefined subops in this group
-                        end
+                        4'b0000: $display("mov r%0d, r%0d", rd, rs);
+                        4'b0001: $display("add r%0d, r%0d", rd, rs);
+                        4'b0010: $display("sub r%0d, r%0d", rd, rs);
+                        4'b0011: $display("lt r%0d, r%0d", rd, rs);
+                        4'b0100: $display("mul r%0d, r%0d", rd, rs);
+                        4'b1000: $display("push r%0d", rs);
+                        4'b1001: $display("lds r%0d", rs);
+                        4'b1010: $display("pop r%0d", rd);
+                        4'b1011: $display("sts r%0d", rd);
+                        4'b1100: $display("ret");
+                        4'b1101: $display("page 0x%0h", instr[7:0]);
+                        default: ;
                     endcase
                 end
-                3'b001: begin
-                    // mvi rd, n : rd = n
-                    regs[rd] <= imm8;
-                    $display("mvi r%0d, 0x%0h", rd, imm8);
-                end
-                3'b010: begin
-                    // stm n, rs : [r15 + n] = rs
-                    ram[regs[15] + imm8] <= regs[rs];
-                    $display("stm 0x%0h, r%0d", imm8, rs);
-                end
-                3'b011: begin
-                    // ldm n, rd : rd = [r15 + n]
-                    regs[rd] <= ram[regs[15] + imm8];
-                    $display("ldm 0x%0h, r%0d", imm8, rd);
-                end
-                3'b100: begin
-                    // jz n, rs : PC = n if rs == 0
-                    $display("jz 0x%0h, r%0d", imm8, rs);
-                end
-                3'b101: begin
-                    // call n : (--sp) = PC; PC = n  (low nibble must be 0000)
-                    ram[sp - 8'd1] <= pc;
-                    sp <= sp - 8'd1;
-                    $display("call 0x%0h", imm8);
-                end
-                default: begin
-                    // 110,111: unused -> HALT
-                    $display("halt");
-                    $finish;
-                end
+                3'b001: $display("mvi r%0d, 0x%0h", rd, imm8);
+                3'b010: $display("stm 0x%0h, r%0d", imm8, rs);
+                3'b011: $display("ldm 0x%0h, r%0d", imm8, rd);
+                3'b100: $display("jz 0x%0h, r%0d", imm8, rs);
+                3'b101: $display("call 0x%0h", imm8);
+                3'b110: $display("jnz 0x%0h, r%0d", imm8, rs);
+                default: ;
             endcase
-
-            // Commit next PC
-            pc <= next_pc;
         end
     end
+`endif
 
-endmodule
\ No newline at end of file
+endmodule
@@ -1,59 +1,166 @@
 `timescale 1ns/1ps
 
-module minc_tb;
+// Run control (plusargs):
+//   +HEX=<file>    image to run (read by minc.sv, default test.hex / program.hex)
+//   +CYCLES=<n>    cycle budget per program (default 1000000); a program
+//                  that has not halted by then is reported as a timeout
+//   +LIST=<file>   batch mode: run every hex file listed in <file> (one path per line),
+//                  resetting the core in between, and print one result line per program:
+//                  "[<index>] PC: <pc>, TOP: <top>, SP: <sp>, Cycles: <cycles>, Status: halted|timeout"
+//                  (vvp exits 0 either way, so the caller has to check Status)
+// Defines: TRACE prints every executed instruction, DUMP writes minc_tb.vcd
+// (e.g. iverilog -DTRACE -DDUMP). Neither is needed for regression runs.
+// Core parameters can be overridden at elaboration, e.g. iverilog -Pminc_tb.HAS_MUL=0
+// or -Pminc_tb.PIPELINED=1 or -Pminc_tb.PC_WIDTH=12. With HAS_PERF the performance counters are read
+// through the debug port after the run and printed by the final block.
+module minc_tb #(
+    parameter bit HAS_MUL   = 1'b1,
+    parameter bit PIPELINED = 1'b0,
+    parameter bit HAS_PERF  = 1'b1,
+    parameter int PC_WIDTH  = 8
+);
 
     reg CLK;
     reg nRESET;
-    wire [7:0] pc_out;
+    wire [PC_WIDTH-1:0] pc_out;
     wire [7:0] top_out;
     wire [7:0] sp_out;
+    wire       core_halted;
+    reg  [3:0]  dbg_sel;
+    wire [31:0] dbg_data;
+    reg  [31:0] counters [0:8];
     integer i;
 
+    integer max_cycles;
+    integer cycles;
+    reg     halted;
+    reg     batch;
+    reg [8*256-1:0] list_path;
+    reg [8*256-1:0] hex_path;
+    integer list_fd;
+    integer n_programs;
+
     // Instantiate the DUT
-    minc uut (
+    minc #(
+        .HAS_MUL(HAS_MUL),
+        .PIPELINED(PIPELINED),
+        .HAS_PERF(HAS_PERF),
+        .PC_WIDTH(PC_WIDTH)
+    ) uut (
         .CLK(CLK),
         .nRESET(nRESET),
         .pc_out(pc_out),
         .top_out(top_out),
-        .sp_out(sp_out)
+        .sp_out(sp_out),
+        .halted(core_halted),
+        .dbg_sel(dbg_sel),
+        .dbg_data(dbg_data)
     );
 
+    // The core has reached a halt, or an unprogrammed ROM word, which the
+    // core's decoder also treats as halt. Pipeline bubbles are counted as cycles.
+    wire halt_now = (core_halted === 1'b1) || (^uut.instr === 1'bx);
+
     // Clock generator: 10 ns period
     initial begin
         CLK = 0;
         forever #5 CLK = ~CLK;
     end
 
-    // Reset sequence
-    initial begin
-        nRESET = 1;
-        #1;
-        nRESET = 0;
-        #20;
-        nRESET = 1;
-    end
-
-    // `ifndef TEST
+    `ifdef DUMP
     // Waveform dump for Icarus / GTKWave
     initial begin
         $dumpfile("minc_tb.vcd");
         $dumpvars(0, minc_tb);
     end
-    // `endif
+    `endif
+
+    // Hold the core in reset until the next falling edge
+    task reset_core;
+        begin
+            nRESET = 0;
+            @(negedge CLK);
+            nRESET = 1;
+        end
+    endtask
+
+    // Replace the ROM image; words past the end of the file read as X (halt)
+    task load_rom(input [8*256-1:0] path);
+        begin
+            for (i = 0; i < (1 << PC_WIDTH); i = i + 1) begin
+                uut.rom[i] = 15'bx;
+            end
+            $readmemh(path, uut.rom);
+        end
+    endtask
+
+    // Clock the core until it reaches a halt or the cycle budget runs out.
+    // Sampled on the falling edge, so the halt itself is counted but not executed.
+    task run_program;
+        begin
+            cycles = 0;
+            halted = 0;
+            while (!halted && cycles < max_cycles) begin
+                cycles = cycles + 1;
+                if (halt_now) begin
+                    halted = 1;
+                end else begin
+                    @(negedge CLK);
+                end
+            end
+        end
+    endtask
+
+    // Copy the performance counters out through the debug port; done
+    // between two clock edges, so the values belong to one cycle
+    task read_counters;
+        begin
+            for (i = 0; i < 9; i = i + 1) begin
+                dbg_sel = i;
+                #0.1;
+                counters[i] = dbg_data;
+            end
+        end
+    endtask
 
-    // Simple monitor and stop after a number of cycles
     initial begin
-        // wait for reset to deassert
-        @(posedge nRESET);
-        // wait a little after reset release
+        dbg_sel = 0;
+        if (!$value$plusargs("CYCLES=%d", max_cycles)) begin
+            max_cycles = 1000000;
+        end
+        batch = $value$plusargs("LIST=%s", list_path);
+
+        // Initial reset (the 1 -> 0 edge triggers the asynchronous reset)
+        nRESET = 1;
         #1;
-        for (i = 0; i < 256; i = i + 1) begin
-            @(posedge CLK);
+
+        if (batch) begin
+            list_fd = $fopen(list_path, "r");
+            if (list_fd == 0) begin
+                $display("Cannot open program list");
+                $finish;
+            end
+            n_programs = 0;
+            while ($fscanf(list_fd, "%s\n", hex_path) == 1) begin
+                load_rom(hex_path);
+                reset_core();
+                run_program();
+                $display("[%0d] PC: %0h, TOP: %0h, SP: %0h, Cycles: %0d, Status: %0s", n_programs, pc_out, top_out, sp_out, cycles,
+                         halted ? "halted" : "timeout");
+                n_programs = n_programs + 1;
+            end
+            $fclose(list_fd);
+        end else begin
+            reset_core();
+            run_program();
+            read_counters();
+            if (!halted) begin
+                $display("Timeout reached, finishing simulation.");
+            end
         end
-        #10;
-        $display("Timeout reached, finishing simulation.");
         $finish;
     end
+
     `ifdef VERBOSE
     // Verbose output on each clock cycle
     initial $display("TIME\tPC\tTOP\tSP");
@@ -61,7 +168,15 @@ module minc_tb;
     `endif
 
     final begin
-        $display("PC: %0h, TOP: %0h, SP: %0h", pc_out, top_out, sp_out);
+        if (!batch) begin
+            $display("PC: %0h, TOP: %0h, SP: %0h", pc_out, top_out, sp_out);
+            $display("Cycles: %0d", cycles);
+            if (HAS_PERF) begin
+                $display("Counters: cycles=%0d retired=%0d push=%0d pop=%0d taken=%0d not_taken=%0d call=%0d ret=%0d mem=%0d",
+                         counters[0], counters[1], counters[2], counters[3], counters[4],
+                         counters[5], counters[6], counters[7], counters[8]);
+            end
+        end
     end
 
 endmodule
@@ -0,0 +1,110 @@
+// Verilator driver for minc.sv (make verilator).
+// Loads a hex image, clocks the core until it halts and prints the
+// same summary as minc_tb.sv and mincsim:
+//   PC: <pc>, TOP: <top>, SP: <sp>
+//   Cycles: <cycles>
+// Cycles are counted like minc_tb.sv: the halt itself is counted but
+// not executed.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "Vminc.h"
+#include "verilated.h"
+
+static void usage(void) {
+    fprintf(stderr, "Usage: minc_vl [-s] [-c max_cycles] file.hex\n");
+    fprintf(stderr, "  -s             print the performance counters\n");
+    fprintf(stderr, "  -c max_cycles  stop after max_cycles clocks (default 1000000)\n");
+}
+
+static void tick(Vminc *core) {
+    core->CLK = 1;
+    core->eval();
+    core->CLK = 0;
+    core->eval();
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    unsigned long max_cycles = 1000000;
+    int stats = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            stats = 1;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            char *end;
+            max_cycles = strtoul(argv[++i], &end, 0);
+            if (*end != '\0' || max_cycles == 0) {
+                fprintf(stderr, "Error: Invalid cycle count '%s'\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            usage();
+            return EXIT_FAILURE;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot open '%s'\n", path);
+        return EXIT_FAILURE;
+    }
+    fclose(fp);
+
+    // minc.sv reads the image named by +HEX in its initial block
+    std::string hex_arg = std::string("+HEX=") + path;
+    const char *vl_argv[] = {argv[0], hex_arg.c_str()};
+    Verilated::commandArgs(2, vl_argv);
+
+    Vminc *core = new Vminc;
+    core->CLK = 0;
+    core->dbg_sel = 0;
+    core->nRESET = 1;
+    core->eval();
+    core->nRESET = 0; // the 1 -> 0 edge triggers the asynchronous reset
+    core->eval();
+    core->nRESET = 1;
+    core->eval();
+
+    unsigned long cycles = 0;
+    int halted = 0;
+    while (!halted && cycles < max_cycles) {
+        cycles++;
+        if (core->halted) {
+            halted = 1;
+        } else {
+            tick(core);
+        }
+    }
+    if (!halted) {
+        printf("Timeout reached, finishing simulation.\n");
+    }
+
+    printf("PC: %x, TOP: %x, SP: %x\n", core->pc_out, core->top_out, core->sp_out);
+    printf("Cycles: %lu\n", cycles);
+    if (stats) {
+        static const char *const names[] = {
+            "cycles", "retired", "push", "pop", "taken", "not_taken", "call", "ret", "mem",
+        };
+        printf("Counters:");
+        for (int i = 0; i < 9; i++) {
+            core->dbg_sel = i;
+            core->eval();
+            printf(" %s=%lu", names[i], (unsigned long)core->dbg_data);
+        }
+        printf("\n");
+    }
+
+    core->final();
+    delete core;
+    return halted ? EXIT_SUCCESS : EXIT_FAILURE;
+}